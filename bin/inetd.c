@@ -34,6 +34,12 @@
 #include <sys/param.h>
 #include <unistd.h>
 
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include <warpcore/warpcore.h>
 
 
@@ -42,30 +48,40 @@ static void usage(const char * const name, const uint32_t nbufs)
     printf("%s\n", name);
     printf("\t -i interface           interface to run over\n");
     printf("\t[-b]                    optional, busy-wait\n");
+    printf("\t[-a]                    optional, busy-wait adaptively\n");
+    printf("\t[-k usec]               optional, have the kernel busy-poll the "
+           "device queue\n");
     printf("\t[-z]                    optional, turn off UDP checksums\n");
     printf("\t[-n buffers]            packet buffers to allocate "
            "(default %u)\n",
            nbufs);
+    printf("\t[-m]                    lock packet buffers into memory\n");
+    printf("\t[-t threads]            optional, serve the ports with this many "
+           "engines and threads\n");
 #ifndef NDEBUG
     printf("\t[-v verbosity]          verbosity level (0-%d, default %d)\n",
            DLEVEL, util_dlevel);
 #endif
 }
 
-// global termination flag
+// global termination flag, set by the signal handler and read by all threads
 static bool done = false;
 
+// whether to busy-wait, and how long to block in w_nic_rx() otherwise
+static bool busywait = false;
+static int64_t wait_nsec = -1;
+
 
 // set the global termination flag; pass signal through after second time
 static void terminate(int signum __attribute__((unused)))
 {
-    if (done) {
+    if (__atomic_load_n(&done, __ATOMIC_RELAXED)) {
         // we've been here before, restore the default signal handlers
         warn(WRN, "got repeated signal, passing through");
         ensure(signal(SIGTERM, SIG_DFL) != SIG_ERR, "signal");
         ensure(signal(SIGINT, SIG_DFL) != SIG_ERR, "signal");
     } else
-        done = true;
+        __atomic_store_n(&done, true, __ATOMIC_RELAXED);
 }
 
 
@@ -75,70 +91,29 @@ struct payload {
 };
 
 
-int
+/// Serve the ports bound on engine @p arg until an interrupt occurs.
+///
+/// @param      arg   A w_engine.
+///
+/// @return     Zero.
+///
+static void *
 #if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
     __attribute__((no_sanitize("alignment")))
 #endif
-    main(const int argc, char * const argv[])
+    serve(void * const arg)
 {
-    const char * ifname = 0;
-    bool busywait = false;
-    struct w_sockopt opt = {0};
-    uint32_t nbufs = 500000;
+    struct w_engine * const w = arg;
 
-    // handle arguments
-    int ch;
-#ifndef NDEBUG
-    while ((ch = getopt(argc, argv, "hi:bzn:v:")) != -1) {
-#else
-    while ((ch = getopt(argc, argv, "hi:bzn:")) != -1) {
-#endif
-        switch (ch) {
-        case 'i':
-            ifname = optarg;
-            break;
-        case 'b':
-            busywait = true;
-            break;
-        case 'z':
-            opt.enable_udp_zero_checksums = true;
-            break;
-        case 'n':
-            nbufs = (uint32_t)MAX(1, strtoul(optarg, 0, 10));
-            break;
-        case 'v':
-            util_dlevel = (short)MIN(DLEVEL, strtoul(optarg, 0, 10));
-            break;
-        case 'h':
-        case '?':
-        default:
-            usage(basename(argv[0]), nbufs);
-            return 0;
-        }
-    }
+    // state of the current flight of the benchmark service
+    struct w_iov_sq tmp = w_iov_sq_initializer(tmp);
+    uint64_t tmp_len = 0;
+    uint64_t nonce = 0;
 
-    if (ifname == 0) {
-        usage(basename(argv[0]), nbufs);
-        return 0;
-    }
-
-    // initialize a warpcore engine on the given network interface
-    struct w_engine * w = w_init(ifname, 0, nbufs);
-
-    // install a signal handler to clean up after interrupt
-    ensure(signal(SIGTERM, &terminate) != SIG_ERR, "signal");
-    ensure(signal(SIGINT, &terminate) != SIG_ERR, "signal");
-
-    // start four inetd-like "small services" and one benchmark of our own
-    for (uint16_t idx = 0; idx < w->addr_cnt; idx++) {
-        w_bind(w, idx, bswap16(7), &opt);
-        w_bind(w, idx, bswap16(9), &opt);
-        w_bind(w, idx, bswap16(55555), &opt);
-    }
     // serve requests on the four sockets until an interrupt occurs
-    while (done == false) {
+    while (__atomic_load_n(&done, __ATOMIC_RELAXED) == false) {
         // receive new data (there may not be any if busy-waiting)
-        if (w_nic_rx(w, busywait ? 0 : -1) == false)
+        if (w_nic_rx(w, busywait ? 0 : wait_nsec) == false)
             continue;
 
         // for each of the small services that have received data...
@@ -153,7 +128,7 @@ int
                 continue;
             warn(DBG, "received %" PRIu " bytes from %s:%u on %s:%u",
                  w_iov_sq_len(&i), w_ntop(&sq_first(&i)->wv_addr, ip_tmp),
-                 bswap16(sq_first(&i)->saddr.port),
+                 bswap16(sq_first(&i)->wv_port),
                  w_ntop(&s->ws_laddr, ip_tmp), bswap16(s->ws_lport));
 
             struct w_iov_sq o = w_iov_sq_initializer(o);
@@ -168,11 +143,7 @@ int
                 // discard; nothing to do
                 break;
 
-            case 55555:;
-                static struct w_iov_sq tmp = w_iov_sq_initializer(tmp);
-                static uint64_t tmp_len = 0;
-                static uint64_t nonce = 0;
-
+            case 55555:
                 if (unlikely(nonce == 0))
                     nonce =
                         ((struct payload *)(void *)sq_first(&i)->buf)->nonce;
@@ -216,7 +187,12 @@ int
 
             // if the current service requires replying with data, do so
             if (!sq_empty(&o)) {
-                w_tx(s, &o);
+                // don't wait for a blocked socket, the client will retry
+                const uint_t cnt = w_iov_sq_cnt(&o);
+                const uint_t left = w_tx(s, &o);
+                if (unlikely(left))
+                    warn(WRN, "could not send %" PRIu " of %" PRIu " pkts",
+                         left, cnt);
                 w_nic_tx(w);
             }
 
@@ -226,7 +202,140 @@ int
         }
     }
 
+    w_free(&tmp);
+    // main() cleans the engine up, possibly from another thread
+    w_release_bufs(w);
+    return 0;
+}
+
+
+int
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    main(const int argc, char * const argv[])
+{
+    const char * ifname = 0;
+    struct w_sockopt opt = {0};
+    struct w_engopt eopt = {0};
+    uint32_t nbufs = 500000;
+    uint32_t threads = 1;
+
+    // handle arguments
+    int ch;
+#ifndef NDEBUG
+    while ((ch = getopt(argc, argv, "hi:abk:mzn:t:v:")) != -1) {
+#else
+    while ((ch = getopt(argc, argv, "hi:abk:mzn:t:")) != -1) {
+#endif
+        switch (ch) {
+        case 'i':
+            ifname = optarg;
+            break;
+        case 'a':
+            eopt.enable_adaptive_poll = true;
+            break;
+        case 'b':
+            busywait = true;
+            break;
+        case 'k':
+            eopt.busy_poll_us = (uint32_t)strtoul(optarg, 0, 10);
+            break;
+        case 'm':
+            eopt.lock_buf_mem = true;
+            break;
+        case 'z':
+            opt.enable_udp_zero_checksums = true;
+            break;
+        case 'n':
+            nbufs = (uint32_t)MAX(1, strtoul(optarg, 0, 10));
+            break;
+        case 't':
+            threads = (uint32_t)MAX(1, strtoul(optarg, 0, 10));
+            break;
+        case 'v':
+            util_dlevel = (short)MIN(DLEVEL, strtoul(optarg, 0, 10));
+            break;
+        case 'h':
+        case '?':
+        default:
+            usage(basename(argv[0]), nbufs);
+            return 0;
+        }
+    }
+
+    if (ifname == 0) {
+        usage(basename(argv[0]), nbufs);
+        return 0;
+    }
+
+    if (threads > 1) {
+#ifdef WITH_NETMAP
+        // each engine serves one ring, and RSS spreads the packets over them
+        eopt.enable_one_ring = true;
+#else
+        // the engines share the ports, and packets are spread over them
+        eopt.enable_reuseport = true;
+#ifdef __linux__
+        // when busy-polling, keep the w_socks of each engine on one queue
+        if (eopt.busy_poll_us)
+            eopt.reuseport_by_queue = true;
+        else
+            eopt.reuseport_by_cpu = true;
+        eopt.reuseport_engines = threads;
+#endif
+#endif
+    }
+
+    // initialize warpcore engines on the given network interface
+    struct w_engine ** const w = calloc(threads, sizeof(*w));
+    ensure(w, "calloc");
+    for (uint32_t t = 0; t < threads; t++) {
+        eopt.ring = t;
+        w[t] = w_init(ifname, 0, nbufs, &eopt);
+        ensure(w[t], "w_init");
+    }
+
+    // install a signal handler to clean up after interrupt
+    ensure(signal(SIGTERM, &terminate) != SIG_ERR, "signal");
+    ensure(signal(SIGINT, &terminate) != SIG_ERR, "signal");
+
+    // start four inetd-like "small services" and one benchmark of our own (in
+    // engine order, which is what packets steered by CPU rely on)
+    for (uint32_t t = 0; t < threads; t++)
+        for (uint16_t idx = 0; idx < w[t]->addr_cnt; idx++) {
+            w_bind(w[t], idx, bswap16(7), &opt);
+            w_bind(w[t], idx, bswap16(9), &opt);
+            w_bind(w[t], idx, bswap16(55555), &opt);
+        }
+
+    if (threads > 1) {
+        // a signal only interrupts one thread, so the others need to wake up
+        // by themselves to notice
+        wait_nsec = 100 * NS_PER_MS;
+        pthread_t * const tid = calloc(threads, sizeof(*tid));
+        ensure(tid, "calloc");
+        for (uint32_t t = 0; t < threads; t++) {
+            ensure(pthread_create(&tid[t], 0, serve, w[t]) == 0,
+                   "pthread_create");
+#ifdef __linux__
+            // run engine t on CPU t, so it handles the packets steered to it
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(t % (uint32_t)sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+            if (pthread_setaffinity_np(tid[t], sizeof(cpus), &cpus) != 0)
+                warn(WRN, "cannot pin thread %u", t);
+#endif
+        }
+        for (uint32_t t = 0; t < threads; t++)
+            pthread_join(tid[t], 0);
+        free(tid);
+    } else
+        serve(w[0]);
+
     // we only get here after an interrupt; clean up
-    w_cleanup(w);
+    for (uint32_t t = 0; t < threads; t++)
+        w_cleanup(w[t]);
+    free(w);
     return 0;
 }
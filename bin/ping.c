@@ -75,6 +75,8 @@ static void usage(const char * const name,
            conns);
     printf("\t[-z]                    turn off UDP checksums\n");
     printf("\t[-b]                    busy-wait\n");
+    printf("\t[-a]                    busy-wait adaptively\n");
+    printf("\t[-m]                    lock packet buffers into memory\n");
 #ifndef NDEBUG
     printf("\t[-v verbosity]          verbosity level (0-%d, default %d)\n",
            DLEVEL, util_dlevel);
@@ -109,14 +111,15 @@ int
     uint32_t conns = 1;
     bool busywait = false;
     struct w_sockopt opt = {0};
+    struct w_engopt eopt = {0};
     uint32_t nbufs = 500000;
 
     // handle arguments
     int ch;
 #ifndef NDEBUG
-    while ((ch = getopt(argc, argv, "hzbi:d:l:r:s:c:e:p:n:v:")) != -1) {
+    while ((ch = getopt(argc, argv, "hzabmi:d:l:r:s:c:e:p:n:v:")) != -1) {
 #else
-    while ((ch = getopt(argc, argv, "hzbi:d:l:r:s:c:e:p:n:")) != -1) {
+    while ((ch = getopt(argc, argv, "hzabmi:d:l:r:s:c:e:p:n:")) != -1) {
 #endif
         switch (ch) {
         case 'i':
@@ -147,9 +150,15 @@ int
         case 'n':
             nbufs = (uint32_t)MAX(1, strtoul(optarg, 0, 10));
             break;
+        case 'a':
+            eopt.enable_adaptive_poll = true;
+            break;
         case 'b':
             busywait = true;
             break;
+        case 'm':
+            eopt.lock_buf_mem = true;
+            break;
         case 'z':
             opt.enable_udp_zero_checksums = true;
             break;
@@ -181,7 +190,7 @@ int
     }
 
     // initialize a warpcore engine on the given network interface
-    struct w_engine * w = w_init(ifname, rip, nbufs);
+    struct w_engine * w = w_init(ifname, rip, nbufs, &eopt);
 
     struct w_sock ** s = calloc(conns, sizeof(struct w_sock *));
     ensure(s, "got sockets");
@@ -239,9 +248,24 @@ int
                 p->len = len;
             }
 
-            // send the data, and wait until it is out
-            w_tx(s[c], &o);
-            w_nic_tx(w);
+            // send the data, and wait until it is out; if the socket blocks,
+            // wait until it is writable again and send the rest
+            struct w_iov_sq sent = w_iov_sq_initializer(sent);
+            for (;;) {
+                // with zero-copy, w_tx() already took the sent w_iovs
+                const uint_t left = w_tx(s[c], &o);
+                for (uint_t n = w_iov_sq_cnt(&o) - left; n; n--) {
+                    v = sq_first(&o);
+                    sq_remove_head(&o, next);
+                    sq_insert_tail(&sent, v, next);
+                }
+                w_nic_tx(w);
+                if (sq_empty(&o))
+                    break;
+                while (s[c]->tx_blocked)
+                    w_nic_rx(w, -1);
+            }
+            sq_concat(&o, &sent);
 
             // get the current time
             struct timespec after_tx;
@@ -71,6 +71,32 @@ sq_head(w_iov_sq, w_iov); ///< Head of the w_iov tail queue.
 #define w_iov_sq_initializer(q) sq_head_initializer(q)
 
 
+#define W_IOV_VEC_MAX 64 ///< Capacity of a w_iov_vec.
+
+/// A fixed-capacity array of w_iov I/O vectors, for use with the *_vec()
+/// variants of the w_iov_sq API. Unlike a w_iov_sq, it can be walked without
+/// chasing pointers, and its length and payload byte count are known in
+/// constant time.
+///
+struct w_iov_vec {
+    uint32_t cnt;                     ///< Number of w_iovs in @p v.
+    uint32_t len;                     ///< Total payload length of @p v.
+    struct w_iov * v[W_IOV_VEC_MAX]; ///< The w_iovs.
+};
+
+
+/// Initializer for struct w_iov_vec.
+///
+/// @param      vec   A struct w_iov_vec.
+///
+/// @return     Empty w_iov_vec, to be assigned to @p vec.
+///
+#define w_iov_vec_initializer(vec)                                             \
+    {                                                                          \
+        0, 0, { 0 }                                                            \
+    }
+
+
 #define IP6_LEN 16 ///< Length of an IPv4 address in bytes. Sixteen.
 #define IP6_STRLEN INET6_ADDRSTRLEN
 
@@ -209,18 +235,118 @@ struct eth_addr {
 #endif
 
 
+/// Engine options.
+///
+struct w_engopt {
+    /// Do not try to back the packet buffer memory with hugepages. (Socket
+    /// backend only.)
+    uint32_t disable_hugepages : 1;
+    /// Lock the packet buffer memory into RAM with mlock(). (Socket backend
+    /// only.)
+    uint32_t lock_buf_mem : 1;
+    /// Register w_socks edge-triggered (with EPOLLET or EV_CLEAR), so that
+    /// w_rx_ready() reports a w_sock once per burst of arrivals rather than
+    /// until it is drained. w_rx() then reads until the kernel has no more
+    /// data, and the application must call it for every reported w_sock.
+    /// (Socket backend with epoll or kqueue only.)
+    uint32_t enable_edge_triggered : 1;
+    /// Have all w_socks that are bound to the same local address and port
+    /// share one kernel socket, and demultiplex the packets it receives to the
+    /// connected w_socks by four-tuple, and to the first unconnected one
+    /// otherwise. A server with many peers then needs a single descriptor and
+    /// event registration per port. Kernel-level socket options apply to the
+    /// shared socket, and UDP GRO and MSG_ZEROCOPY are not available. (Socket
+    /// backend without io_uring only.)
+    uint32_t enable_virtual_socks : 1;
+    /// Allow other engines on the same interface, and bind w_socks with
+    /// SO_REUSEPORT, so that the kernel spreads the packets for a port over
+    /// the w_socks that different engines bound to it (by four-tuple hash.)
+    /// Each engine is then typically served by its own thread. (Socket backend
+    /// only.)
+    uint32_t enable_reuseport : 1;
+    /// With @p enable_reuseport, steer each packet to the w_sock that was bound
+    /// to its port in the position of the CPU it was received on (modulo
+    /// @p reuseport_engines), so engines pinned to CPUs should bind their
+    /// w_socks in CPU order. (Socket backend on Linux only.)
+    uint32_t reuseport_by_cpu : 1;
+    /// With @p enable_reuseport, steer each packet to the w_sock that was bound
+    /// to its port in the position of the device RX queue it was received on
+    /// (modulo @p reuseport_engines) instead. The w_socks of each engine then
+    /// all receive from the same queue (NAPI instance), so that
+    /// @p busy_poll_us covers all of them. (Socket backend on Linux only.)
+    uint32_t reuseport_by_queue : 1;
+    /// Only register RX and TX ring pair @p ring of the interface, rather than
+    /// all of them. One engine per hardware queue can then run on its own
+    /// core. The engines on the rings of an interface share the neighbor cache
+    /// and keep their connected w_socks unique, while each owns its rings and
+    /// extra buffers, and only sees the packets (RSS) steers to its ring.
+    /// (Netmap backend only.)
+    uint32_t enable_one_ring : 1;
+    /// With @p enable_one_ring, have w_connect() pick a local port for which
+    /// the Toeplitz RSS hash of the NIC steers the replies to the ring of this
+    /// engine, so that each connection stays on one core. (Netmap backend
+    /// only, and only if the NIC hashes UDP ports.)
+    uint32_t enable_rss_ports : 1;
+    /// Have a blocking w_nic_rx() busy-poll for a while before it blocks, as
+    /// long as packets recently arrived closely enough together that spinning
+    /// is likely to pay off: for up to twice the average interval between
+    /// arrivals, but at most @p spin_ns.
+    uint32_t enable_adaptive_poll : 1;
+    /// With @p busy_poll_us, also set SO_PREFER_BUSY_POLL, so that the kernel
+    /// defers device interrupts while the application keeps busy-polling.
+    /// This needs the napi_defer_hard_irqs and gro_flush_timeout settings of
+    /// the interface to be non-zero. (Socket backend on Linux only.)
+    uint32_t enable_prefer_busy_poll : 1;
+    uint32_t : 21;
+    /// Grow the packet buffer pool on demand, in hugepage-sized chunks, up to
+    /// this many buffers in total, and release idle chunks again. Zero (or a
+    /// value not larger than @p nbufs) keeps the pool at its initial size.
+    /// (Socket backend only.)
+    uint32_t max_bufs;
+    /// Process at most this many received packets per w_nic_rx() call, and
+    /// leave the rest in the RX rings for the next one; see
+    /// w_nic_rx_pending(). Zero means no limit. (Netmap backend only.)
+    uint32_t rx_budget;
+    /// Number of engines sharing ports when @p reuseport_by_cpu or
+    /// @p reuseport_by_queue is set.
+    uint32_t reuseport_engines;
+    /// Ring pair to register when @p enable_one_ring is set.
+    uint32_t ring;
+    /// Longest time in nanoseconds that w_nic_rx() busy-polls when
+    /// @p enable_adaptive_poll is set. Zero means #W_SPIN_NS.
+    uint32_t spin_ns;
+    /// Have the kernel busy-poll the device queue for up to this many
+    /// microseconds whenever a w_sock or w_nic_rx() would otherwise sleep
+    /// until a softirq wakes it up (SO_BUSY_POLL, and EPIOCSPARAMS for epoll.)
+    /// Epoll busy-polls the queue (NAPI ID) of only one w_sock at a time, so
+    /// each engine should serve w_socks of one queue; see w_napi_id() and
+    /// @p reuseport_by_queue. Raising this beyond the net.core.busy_read
+    /// sysctl needs CAP_NET_ADMIN. Zero disables busy-polling. (Socket backend
+    /// on Linux only.)
+    uint32_t busy_poll_us;
+};
+
+
+/// Default for w_engopt::spin_ns.
+#define W_SPIN_NS (50 * NS_PER_US)
+
+
 /// A warpcore backend engine.
 ///
 struct w_engine {
     void * mem;           ///< Pointer to netmap or socket buffer memory region.
     struct w_iov * bufs;  ///< Pointer to w_iov buffers.
+    /// Storage for the w_iov::saddr of the w_iovs in @p bufs (same index.)
+    struct w_sockaddr * bufs_saddr;
     struct w_backend * b; ///< Backend.
     uint16_t mtu;         ///< MTU of this interface.
     uint32_t mbps;        ///< Link speed of this interface in Mb/s.
     struct eth_addr mac;  ///< Local Ethernet MAC address of the interface.
     // struct eth_addr rip;  ///< Ethernet MAC address of the next-hop router.
 
-    struct w_iov_sq iov; ///< Tail queue of w_iov buffers available.
+    /// Tail queue of w_iov buffers available (the "depot"). Each thread also
+    /// keeps a small cache of w_iovs of this engine; see w_release_bufs().
+    struct w_iov_sq iov;
 
     sl_entry(w_engine) next;      ///< Pointer to next engine.
     char ifname[IFNAMSIZ];        ///< Name of the interface of this engine.
@@ -231,6 +357,11 @@ struct w_engine {
     /// Pointer to generic user data (not used by warpcore.)
     void * data;
 
+    uint64_t __rx_t;   ///< Internal use.
+    uint64_t __rx_gap; ///< Internal use.
+    uint64_t __gen;    ///< Internal use.
+
+    struct w_engopt opt; ///< Engine options.
     uint16_t addr_cnt;
     uint16_t addr4_pos;
     uint8_t have_ip4 : 1;
@@ -238,6 +369,8 @@ struct w_engine {
     uint8_t is_loopback : 1;
     uint8_t is_right_pipe : 1;
     uint8_t : 4;
+    bool __depot_lock; ///< Internal use.
+    bool __closing;    ///< Internal use.
     struct w_ifaddr ifaddr[];
 };
 
@@ -263,13 +396,33 @@ struct w_sockopt {
     uint32_t enable_udp_zero_checksums : 1;
     /// Enable ECN, by setting ECT(0) on all packets.
     uint32_t enable_ecn : 1;
-    uint32_t : 27;
+    /// Do not coalesce outgoing packets into UDP GSO super-datagrams, even if
+    /// the kernel supports it. (Socket backend only.)
+    uint32_t disable_udp_gso : 1;
+    /// Have the kernel coalesce incoming packets into UDP GRO super-datagrams,
+    /// which w_rx() splits back into individual w_iovs. (Socket backend only.)
+    uint32_t enable_udp_gro : 1;
+    /// Transmit with MSG_ZEROCOPY. w_tx() then takes the w_iovs it sends out of
+    /// the passed tail queue, and w_tx_done() returns them once the kernel is
+    /// done with them. (Socket backend on Linux only.)
+    uint32_t enable_zerocopy : 1;
+    /// Do not verify the UDP checksum of incoming packets during w_rx(); the
+    /// application calls w_iov_verify() on the w_iovs it actually consumes.
+    /// (Netmap backend only; the kernel always verifies for the socket
+    /// backend.)
+    uint32_t enable_lazy_udp_checksums : 1;
+    uint32_t : 23;
     uint32_t user_1 : 1; ///< User flag 1 (not used by warpcore.)
     uint32_t user_2 : 1; ///< User flag 2 (not used by warpcore.)
     uint32_t user_3 : 1; ///< User flag 3 (not used by warpcore.)
 };
 
 
+struct w_hdr;
+struct w_mmsg;
+struct w_mux;
+struct w_zc;
+
 /// A warpcore socket.
 ///
 struct w_sock {
@@ -287,9 +440,28 @@ struct w_sock {
 
     sl_entry(w_sock) next; ///< Next socket.
 
-#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
-    sl_entry(w_sock) __next; ///< Internal use.
-#endif
+    // the internal fields below are present in every build, so that the layout
+    // does not depend on which backend library an application links against
+    struct w_zc * __zc;       ///< Internal use.
+    struct w_mmsg * __mm;     ///< Internal use.
+    struct w_hdr * __hdr;     ///< Internal use.
+    struct w_mux * __mux;     ///< Internal use.
+    sl_entry(w_sock) __ready; ///< Internal use.
+    sl_entry(w_sock) __next;  ///< Internal use.
+
+    /// Whether the last w_tx() could not hand off all w_iovs, because the send
+    /// buffer (or TX rings) were full. w_nic_rx() and w_rx_ready() report the
+    /// w_sock once it becomes writable again, and this is then cleared.
+    bool tx_blocked;
+
+    bool __tx_ready;    ///< Internal use.
+    bool __on_ready;    ///< Internal use.
+    bool __rx_armed;    ///< Internal use.
+    uint32_t __pfd;     ///< Internal use.
+    uint32_t __napi_id; ///< Internal use.
+    /// @cond
+    uint8_t _unused[4]; ///< @internal Padding.
+                        /// @endcond
 };
 
 
@@ -315,19 +487,19 @@ struct w_sock {
 /// can be used to chain together longer data items for use with w_rx() and
 /// w_tx().
 ///
+/// Each w_iov occupies one cache line. The fields touched per packet when
+/// walking a w_iov_sq come first and fit into half a cache line; the sender
+/// address lives in an array parallel to w_engine::bufs.
+///
 struct w_iov {
+    uint8_t * buf;        ///< Start of payload data.
+    sq_entry(w_iov) next; ///< Next w_iov in a w_iov_sq.
+
     /// Pointer back to the warpcore instance associated with this w_iov.
     struct w_engine * w;
 
-    /// Sender IP address and port on RX. Destination IP address and port on TX
-    /// on a disconnected w_sock. Ignored on TX on a connected w_sock.
-    struct w_sockaddr saddr;
-
-    uint8_t * base;       ///< Absolute start of buffer.
-    uint8_t * buf;        ///< Start of payload data.
-    sq_entry(w_iov) next; ///< Next w_iov in a w_iov_sq.
-    uint32_t idx;         ///< Index of netmap buffer.
-    uint16_t len;         ///< Length of payload data.
+    uint32_t idx; ///< Index of netmap buffer.
+    uint16_t len; ///< Length of payload data.
 
     /// DSCP + ECN of the received IP packet on RX, DSCP + ECN to use for the
     /// to-be-transmitted IP packet on TX.
@@ -336,17 +508,33 @@ struct w_iov {
     /// TTL of received IP packets.
     uint8_t ttl;
 
+    uint8_t * base; ///< Absolute start of buffer.
+
+    /// Sender IP address and port on RX. Destination IP address and port on TX
+    /// on a disconnected w_sock. Ignored on TX on a connected w_sock. Use the
+    /// wv_* accessors.
+    struct w_sockaddr * saddr;
+
     /// Can be used by application to maintain arbitrary data. Not used by
     /// warpcore.
     uint16_t user_data;
-};
 
+    /// Whether the UDP checksum of this received packet is still unverified.
+    /// Internal use; see w_iov_verify().
+    uint8_t __unverified;
+
+    /// @cond
+    /// @internal Padding to a full cache line.
+    uint8_t _unused[64 - 5 * sizeof(void *) - 11];
+    /// @endcond
+} __attribute__((aligned(64)));
 
-#define wv_port saddr.port
-#define wv_af saddr.addr.af
-#define wv_ip4 saddr.addr.ip4
-#define wv_ip6 saddr.addr.ip6
-#define wv_addr saddr.addr
+
+#define wv_port saddr->port
+#define wv_af saddr->addr.af
+#define wv_ip4 saddr->addr.ip4
+#define wv_ip6 saddr->addr.ip6
+#define wv_addr saddr->addr
 
 
 /// Return the index of w_iov @p v.
@@ -465,11 +653,17 @@ w_is_private(const struct w_addr * const a)
 }
 
 
-extern struct w_engine * __attribute__((nonnull))
-w_init(const char * const ifname, const uint32_t rip, const uint_t nbufs);
+extern struct w_engine * __attribute__((nonnull(1)))
+w_init(const char * const ifname,
+       const uint32_t rip,
+       const uint_t nbufs,
+       const struct w_engopt * const opt);
 
 extern void __attribute__((nonnull)) w_cleanup(struct w_engine * const w);
 
+extern void __attribute__((nonnull))
+w_release_bufs(struct w_engine * const w);
+
 extern struct w_sock * __attribute__((nonnull(1)))
 w_bind(struct w_engine * const w,
        const uint16_t addr_idx,
@@ -501,19 +695,27 @@ w_alloc_iov(struct w_engine * const w,
             const uint16_t len,
             const uint16_t off);
 
-extern void __attribute__((nonnull))
+extern uint_t __attribute__((nonnull))
 w_tx(struct w_sock * const s, struct w_iov_sq * const o);
 
+extern void __attribute__((nonnull))
+w_tx_done(struct w_sock * const s, struct w_iov_sq * const q);
+
 extern uint_t w_iov_sq_len(const struct w_iov_sq * const q);
 
 extern void __attribute__((nonnull))
 w_rx(struct w_sock * const s, struct w_iov_sq * const i);
 
+extern bool __attribute__((nonnull)) w_iov_verify(struct w_iov * const v);
+
 extern void __attribute__((nonnull)) w_nic_tx(struct w_engine * const w);
 
 extern bool __attribute__((nonnull))
 w_nic_rx(struct w_engine * const w, const int64_t nsec);
 
+extern bool __attribute__((nonnull))
+w_nic_rx_pending(const struct w_engine * const w);
+
 extern uint32_t __attribute__((nonnull))
 w_rx_ready(struct w_engine * const w, struct w_sock_slist * sl);
 
@@ -524,6 +726,22 @@ extern void __attribute__((nonnull)) w_free(struct w_iov_sq * const q);
 
 extern void __attribute__((nonnull)) w_free_iov(struct w_iov * const v);
 
+extern uint32_t __attribute__((nonnull))
+w_alloc_cnt_vec(struct w_engine * const w,
+                const int af,
+                struct w_iov_vec * const vec,
+                const uint32_t count,
+                const uint16_t len,
+                const uint16_t off);
+
+extern uint32_t __attribute__((nonnull))
+w_tx_vec(struct w_sock * const s, struct w_iov_vec * const vec);
+
+extern uint32_t __attribute__((nonnull))
+w_rx_vec(struct w_sock * const s, struct w_iov_vec * const vec);
+
+extern void __attribute__((nonnull)) w_free_vec(struct w_iov_vec * const vec);
+
 extern const char * __attribute__((nonnull))
 w_ntop(const struct w_addr * const addr, char * const dst);
 
@@ -547,6 +765,9 @@ w_sockaddr_cmp(const struct w_sockaddr * const a,
 extern void __attribute__((nonnull))
 w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt);
 
+extern uint32_t __attribute__((nonnull))
+w_napi_id(const struct w_sock * const s);
+
 extern uint64_t w_now(const clockid_t clock);
 
 extern void w_nanosleep(const uint64_t ns);
@@ -36,13 +36,19 @@
 
 #ifdef WITH_NETMAP
 #include <net/netmap_user.h>
+#include <pthread.h>
 #endif
 
+#include <limits.h>
+#include <time.h>
+
 #include <warpcore/warpcore.h>
 
-#if defined(HAVE_KQUEUE)
+#if defined(WITH_URING)
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#elif defined(HAVE_KQUEUE)
 #include <sys/event.h>
-#include <time.h>
 #elif defined(HAVE_EPOLL)
 #include <sys/epoll.h>
 #elif !defined(PARTICLE) && !defined(RIOT_VERSION)
@@ -53,47 +59,163 @@
 #include "arp.h"
 #include "eth.h"
 #include "neighbor.h"
+#include "rss.h"
 #include "udp.h"
+#endif
 
-KHASH_INIT(sock,
-           struct w_socktuple *,
-           struct w_sock *,
-           1,
-           w_socktuple_hash,
-           w_socktuple_cmp)
+#if !defined(WITH_URING) && !defined(RIOT_VERSION)
+#include "flowtab.h"
+#endif
+
+#ifdef WITH_NETMAP
+sl_head(w_backend_slist, w_backend);
+
+
+/// State shared by the engines that each register a different ring of the same
+/// interface; see w_engopt::enable_one_ring. An engine that registers all rings
+/// (or a netmap pipe) has a group of its own.
+///
+struct nm_group {
+    sl_entry(nm_group) next;        ///< Pointer to next group.
+    char ifname[IFNAMSIZ];          ///< Name of the interface of this group.
+    pthread_mutex_t lock;           ///< Protects @p neighbor and member socks.
+    khash_t(neighbor) neighbor;     ///< The ARP cache.
+    struct w_backend_slist members; ///< Backends of the engines in the group.
+    struct rss rss; ///< RSS configuration; see w_engopt::enable_rss_ports.
+    bool one_ring;  ///< Whether the members each use one ring.
+    /// @cond
+    uint8_t _unused[3]; ///< @internal Padding.
+                        /// @endcond
+};
+#else
+sl_head(w_mux_slist, w_mux);
 #endif
 
 
 struct w_backend {
 #ifdef WITH_NETMAP
-    int fd;                     ///< Netmap file descriptor.
-    uint32_t cur_txr;           ///< Index of the TX ring currently active.
-    struct netmap_if * nif;     ///< Netmap interface.
-    struct nmreq * req;         ///< Netmap request structure.
-    khash_t(neighbor) neighbor; ///< The ARP cache.
-    uint32_t * tail;            ///< TX ring tails after last NIOCTXSYNC call.
-    struct w_iov *** slot_buf;  ///< For each ring slot, a pointer to its w_iov.
-    khash_t(sock) sock;         ///< List of open (bound) w_sock sockets.
+    int fd;                    ///< Netmap file descriptor.
+    uint32_t cur_txr;          ///< Registered TX ring currently active.
+    struct netmap_if * nif;    ///< Netmap interface.
+    struct nmreq * req;        ///< Netmap request structure.
+    struct nm_group * grp;     ///< Group of engines sharing the interface.
+    sl_entry(w_backend) next;  ///< Pointer to next backend in @p grp.
+    uint32_t * tail;           ///< TX ring tails after last NIOCTXSYNC call.
+    struct w_iov *** slot_buf; ///< For each ring slot, a pointer to its w_iov.
+    struct flowtab sock;       ///< Open (bound) w_sock sockets.
+    /// w_socks that received data or became writable since they were last
+    /// returned by w_rx_ready().
+    struct w_sock_slist ready;
+    /// The w_sock that udp_rx() last demultiplexed a packet to during the
+    /// current w_nic_rx() RX burst, or zero.
+    struct w_sock * rx_sock;
+    struct w_socktuple rx_tup; ///< The four-tuple that matched @p rx_sock.
+    uint32_t cur_rxr;          ///< Registered RX ring to service first.
+    uint32_t first_ring;       ///< Index of the first registered ring.
+    uint32_t ntxr;             ///< Number of registered TX rings.
+    uint32_t nrxr;             ///< Number of registered RX rings.
+    bool tx_blocked;           ///< Whether a w_sock is blocked on TX.
+    bool rx_pending;           ///< Whether w_nic_rx() ran out of budget.
+    /// @cond
+    uint8_t _unused[2]; ///< @internal Padding.
+                        /// @endcond
 #else
-#if defined(HAVE_KQUEUE)
-    struct kevent ev[64]; // XXX arbitrary value
+#if defined(WITH_URING)
+    int ring;                       ///< io_uring file descriptor.
+    uint32_t sq_entries;            ///< Number of submission queue entries.
+    uint32_t sq_mask;               ///< Submission queue index mask.
+    uint32_t sq_local;              ///< Local submission queue tail.
+    uint32_t * sq_head;             ///< Submission queue head.
+    uint32_t * sq_tail;             ///< Submission queue tail.
+    struct io_uring_sqe * sqe;      ///< Submission queue entries.
+    uint32_t * cq_head;             ///< Completion queue head.
+    uint32_t * cq_tail;             ///< Completion queue tail.
+    struct io_uring_cqe * cqe;      ///< Completion queue entries.
+    uint32_t cq_mask;               ///< Completion queue index mask.
+    uint32_t fixed_bufs;            ///< Buffers per registered fixed buffer.
+    size_t fixed_len;               ///< Length of all registered buffers.
+    void * sq_ring;                 ///< Mapped submission queue ring.
+    void * cq_ring;                 ///< Mapped completion queue ring.
+    size_t sq_ring_len;             ///< Length of @p sq_ring.
+    size_t cq_ring_len;             ///< Length of @p cq_ring.
+    size_t sqe_len;                 ///< Length of @p sqe.
+    struct io_uring_buf_ring * br;  ///< Provided buffer ring for RX.
+    size_t br_len;                  ///< Length of @p br.
+    struct w_iov ** br_iov;         ///< w_iov provided for each buffer ID.
+    uint16_t * br_free;             ///< Buffer IDs without a w_iov.
+    uint16_t br_nfree;              ///< Number of entries in @p br_free.
+    uint16_t br_mask;               ///< Provided buffer ring index mask.
+    uint16_t br_tail;               ///< Local provided buffer ring tail.
+    bool br_starved;                ///< Whether some RX ran out of buffers.
+    bool cancel_done;               ///< Whether an RX cancellation completed.
+    struct msghdr rx_msg;           ///< Template for multishot recvmsg.
+    struct w_sock_slist socks;      ///< List of open (bound) w_sock sockets.
+    struct w_sock * closing;        ///< w_sock being closed, if any.
+    int * tx_res;                   ///< Results of in-flight sends.
+    uint32_t tx_pending;            ///< Number of in-flight sends.
+#elif defined(HAVE_KQUEUE)
+    struct kevent * ev; ///< Event list, two entries per registered w_sock.
+    uint32_t ev_len;    ///< Capacity of @p ev.
+    uint32_t nsocks;    ///< Number of registered w_socks.
     int kq;
 #elif defined(HAVE_EPOLL)
+    struct epoll_event * ev; ///< Event list, one entry per registered w_sock.
+    uint32_t ev_len;         ///< Capacity of @p ev.
+    uint32_t nsocks;         ///< Number of registered w_socks.
     int ep;
-    struct epoll_event ev[64]; // XXX arbitrary value
+    /// NAPI ID of the device queue the w_socks of this engine receive from,
+    /// or zero; see w_engopt::busy_poll_us.
+    uint32_t napi_id;
 #else
 #ifndef RIOT_VERSION
-    struct pollfd * fds;
+    struct pollfd * fds;       ///< Persistent poll() set, one per w_sock.
+    struct w_sock ** fds_sock; ///< The w_sock of each entry in @p fds.
+    uint32_t nfds;             ///< Number of entries in @p fds.
+    uint32_t fds_len;          ///< Capacity of @p fds and @p fds_sock.
 #else
     fd_set fds;
     gnrc_netif_t * nif;
 #endif
     struct w_sock_slist socks;
 #endif
+#if !defined(WITH_URING) && !defined(RIOT_VERSION)
+    /// Virtual w_socks, by four-tuple or local address and port; see
+    /// w_engopt::enable_virtual_socks.
+    struct flowtab vsock;
+    struct w_mux_slist mux; ///< Kernel sockets shared by virtual w_socks.
+    /// Virtual w_socks that received data or became writable since they were
+    /// last returned by w_rx_ready().
+    struct w_sock_slist ready;
+#endif
+    size_t mem_len;        ///< Length of w_engine::mem.
+    uint8_t ** chunk;      ///< Buffer memory chunks added by backend_grow().
+    uint32_t * chunk_free; ///< Number of buffers of each chunk in the depot.
+    size_t chunk_len;      ///< Mapped length of each chunk.
+    uint64_t shrink_t;     ///< Time of the last backend_shrink() scan.
+    uint32_t nbufs;        ///< Number of buffers in w_engine::mem.
+    uint32_t chunk_bufs;   ///< Number of buffers per chunk.
+    uint32_t nchunks;      ///< Number of chunks currently mapped.
+    uint32_t max_chunks;   ///< Number of chunks w_engopt::max_bufs allows.
+#ifdef HAVE_UDP_GRO
+    uint8_t * gro_buf; ///< Receive space for UDP GRO super-datagrams.
+#endif
+    /// Number of w_iovs the w_socks of this engine keep bound to their receive
+    /// slots between w_rx() calls.
+    uint32_t rx_pinned;
     int n;
+    /// Whether a thread is in backend_grow() or backend_shrink(), which change
+    /// @p chunk and @p nchunks.
+    bool resizing;
+#ifdef HAVE_UDP_GSO
+    bool gso; ///< Whether the kernel supports UDP GSO (UDP_SEGMENT).
 #ifndef HAVE_KQUEUE
     /// @cond
-    uint8_t _unused[4]; ///< @internal Padding.
+    uint8_t _unused[2]; ///< @internal Padding.
+                        /// @endcond
+#endif
+#elif !defined(HAVE_KQUEUE)
+    /// @cond
+    uint8_t _unused[3]; ///< @internal Padding.
                         /// @endcond
 #endif
 #endif
@@ -104,6 +226,21 @@ struct w_backend {
 #define max_buf_len(w) (uint16_t)((w)->mtu)
 #define iov_off(w, af)                                                         \
     (sizeof(struct eth_hdr) + ip_hdr_len(af) + sizeof(struct udp_hdr))
+#elif defined(WITH_URING)
+/// Space for the source address of a multishot recvmsg, padded so that the
+/// control data following it is aligned.
+#define URING_NAME_LEN CMSG_ALIGN(sizeof(struct sockaddr_in6))
+
+/// Space for the control data of a multishot recvmsg (TOS and TTL).
+#define URING_CTRL_LEN (2 * CMSG_SPACE(sizeof(int)))
+
+/// Space that multishot recvmsg places before the payload in each buffer.
+#define URING_RX_HDR                                                           \
+    (sizeof(struct io_uring_recvmsg_out) + URING_NAME_LEN + URING_CTRL_LEN)
+
+#define max_buf_len(w)                                                         \
+    (uint16_t)(((w)->mtu - 28 + URING_RX_HDR + 7) & ~7U) // 28 = IP4 + UDP hdr
+#define iov_off(w, af) (uint16_t) URING_RX_HDR
 #else
 #define max_buf_len(w)                                                         \
     (uint16_t)((w)->mtu - 28) // 28 = min_hdr(IP4, IP6) + UDP hdr
@@ -127,10 +264,102 @@ is_pipe(const struct w_engine * const w
 }
 
 
+/// Acquire the lock protecting the depot (w_engine::iov) of engine @p w.
+///
+/// @param      w     Backend engine.
+///
+static inline void __attribute__((nonnull, always_inline))
+depot_lock(struct w_engine * const w)
+{
+    while (unlikely(__atomic_test_and_set(&w->__depot_lock, __ATOMIC_ACQUIRE)))
+        ;
+}
+
+
+/// Release the lock protecting the depot (w_engine::iov) of engine @p w.
+///
+/// @param      w     Backend engine.
+///
+static inline void __attribute__((nonnull, always_inline))
+depot_unlock(struct w_engine * const w)
+{
+    __atomic_clear(&w->__depot_lock, __ATOMIC_RELEASE);
+}
+
+
+#ifndef WITH_NETMAP
+/// Account for @p n linked w_iovs starting at @p v entering (if @p in is true)
+/// or leaving the depot of engine @p w, in the per-chunk free counters that
+/// backend_shrink() relies on. Must be called with the depot lock held.
+///
+/// @param      w     Backend engine.
+/// @param[in]  v     First w_iov.
+/// @param[in]  n     Number of w_iovs.
+/// @param[in]  in    Whether the w_iovs enter the depot.
+///
+static inline void __attribute__((nonnull(1)))
+depot_count(struct w_engine * const w,
+            const struct w_iov * v,
+            uint_t n,
+            const bool in)
+{
+    const struct w_backend * const b = w->b;
+    if (likely(b->nchunks == 0))
+        return;
+    for (; n; n--, v = sq_next(v, next))
+        if (v->idx >= b->nbufs) {
+            uint32_t * const f =
+                &b->chunk_free[(v->idx - b->nbufs) / b->chunk_bufs];
+            *f = in ? *f + 1 : *f - 1;
+        }
+}
+#else
+#define depot_count(...)
+#endif
+
+
+/// Link the w_iovs in @p vec, in order, into tail queue @p q.
+///
+/// @param[in]  vec   A non-empty w_iov_vec.
+/// @param[out] q     Tail queue to initialize.
+///
+static inline void __attribute__((nonnull, no_instrument_function))
+vec_to_sq(const struct w_iov_vec * const vec, struct w_iov_sq * const q)
+{
+    const uint32_t last = vec->cnt - 1;
+    for (uint32_t j = 0; likely(j < last); j++)
+        sq_next(vec->v[j], next) = vec->v[j + 1];
+    sq_next(vec->v[last], next) = 0;
+    sq_first(q) = vec->v[0];
+    q->stqh_last = &sq_next(vec->v[last], next);
+    sq_len(q) = vec->cnt;
+}
+
+
+/// Append the w_iovs in tail queue @p q to @p vec, as far as they fit, and
+/// unlink them.
+///
+/// @param      q     Tail queue to take w_iovs from.
+/// @param      vec   A w_iov_vec.
+///
+static inline void __attribute__((nonnull, no_instrument_function))
+sq_to_vec(struct w_iov_sq * const q, struct w_iov_vec * const vec)
+{
+    while (vec->cnt < W_IOV_VEC_MAX && sq_empty(q) == false) {
+        struct w_iov * const v = sq_first(q);
+        sq_remove_head(q, next);
+        sq_next(v, next) = 0;
+        vec->v[vec->cnt++] = v;
+        vec->len += v->len;
+    }
+}
+
+
 /// For a given buffer index, get a pointer to its beginning.
 ///
 /// Since netmap uses a macro for this, we also need to use a macro for the
-/// socket backend.
+/// socket backend. There, the first w_backend::nbufs buffers live in
+/// w_engine::mem, and any further ones in the chunks added by backend_grow().
 ///
 /// @param      w     Backend engine.
 /// @param      i     Buffer index.
@@ -143,11 +372,66 @@ idx_to_buf(const struct w_engine * const w, const uint32_t i)
 #ifdef WITH_NETMAP
     return (uint8_t *)NETMAP_BUF(NETMAP_TXRING(w->b->nif, 0), i);
 #else
-    return (uint8_t *)w->mem + ((intptr_t)i * max_buf_len(w));
+    if (likely(i < w->b->nbufs))
+        return (uint8_t *)w->mem + ((intptr_t)i * max_buf_len(w));
+    const uint32_t j = i - w->b->nbufs;
+    return w->b->chunk[j / w->b->chunk_bufs] +
+           ((intptr_t)(j % w->b->chunk_bufs) * max_buf_len(w));
 #endif
 }
 
 
+#if !defined(WITH_URING) && !defined(RIOT_VERSION)
+/// Queue w_sock @p s for the next w_rx_ready() call, unless it already is.
+///
+/// @param      s     A w_sock that received data or became writable.
+///
+static inline void __attribute__((nonnull, always_inline))
+mark_ready(struct w_sock * const s)
+{
+    if (likely(s->__on_ready == false)) {
+        s->__on_ready = true;
+        sl_insert_head(&s->w->b->ready, s, __ready);
+    }
+}
+#endif
+
+
+/// Convert w_nic_rx() timeout @p nsec into a poll() or epoll_wait() timeout,
+/// rounding up, so that a sub-millisecond timeout still blocks.
+///
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+///
+/// @return     Timeout in milliseconds, or -1 for infinite wait.
+///
+static inline int __attribute__((always_inline, const))
+timeout_ms(const int64_t nsec)
+{
+    return nsec < 0 ? -1
+                    : (int)MIN(INT_MAX, ((uint64_t)nsec + NS_PER_MS - 1) /
+                                            NS_PER_MS);
+}
+
+
+/// Convert w_nic_rx() timeout @p nsec into a timespec for ppoll(),
+/// epoll_pwait2() or kevent().
+///
+/// @param[in]  nsec  Timeout in nanoseconds, or -1 for infinite wait.
+/// @param[out] ts    The timespec to fill in.
+///
+/// @return     @p ts, or zero for infinite wait.
+///
+static inline struct timespec * __attribute__((always_inline, nonnull))
+timeout_ts(const int64_t nsec, struct timespec * const ts)
+{
+    if (nsec < 0)
+        return 0;
+    ts->tv_sec = (time_t)((uint64_t)nsec / NS_PER_S);
+    ts->tv_nsec = (long)((uint64_t)nsec % NS_PER_S);
+    return ts;
+}
+
+
 static inline uint16_t __attribute__((always_inline)) pick_local_port(void)
 {
     // compute a random port >= 1024
@@ -178,6 +462,11 @@ contig_mask_len(const int af, const uint8_t * const mask);
 extern void __attribute__((nonnull))
 init_iov(struct w_engine * const w, struct w_iov * const v, const uint32_t idx);
 
+extern void __attribute__((nonnull))
+alloc_bufs(struct w_engine * const w, const uint32_t n);
+
+extern void __attribute__((nonnull)) free_bufs(struct w_engine * const w);
+
 extern struct w_iov * __attribute__((nonnull))
 w_alloc_iov_base(struct w_engine * const w);
 
@@ -196,6 +485,13 @@ backend_init(struct w_engine * const w, const uint32_t nbufs);
 
 extern void __attribute__((nonnull)) backend_cleanup(struct w_engine * const w);
 
+extern bool __attribute__((nonnull(1)))
+backend_nic_rx(struct w_engine * const w,
+               const int64_t nsec,
+               bool * const rcvd);
+
+extern bool __attribute__((nonnull)) backend_grow(struct w_engine * const w);
+
 extern struct w_sock * __attribute__((nonnull(1, 2)))
 w_get_sock(struct w_engine * const w,
            const struct w_sockaddr * const local,
@@ -206,3 +502,33 @@ to_sockaddr(struct sockaddr * const sa,
             const struct w_addr * const addr,
             const uint16_t port,
             const uint32_t scope_id);
+
+#ifdef WITH_NETMAP
+extern bool __attribute__((nonnull))
+group_demux(struct w_engine * const w,
+            const struct w_sockaddr * const local,
+            const struct w_sockaddr * const remote);
+#else
+extern uint16_t __attribute__((nonnull))
+rx_cmsg(struct msghdr * const mh, struct w_iov * const v);
+
+extern void __attribute__((nonnull)) backend_shrink(struct w_engine * const w);
+#endif
+
+#ifdef WITH_URING
+extern void __attribute__((nonnull))
+uring_init(struct w_engine * const w, const uint32_t nbufs);
+
+extern void __attribute__((nonnull)) uring_cleanup(struct w_engine * const w);
+
+extern void __attribute__((nonnull)) uring_bind(struct w_sock * const s);
+
+extern void __attribute__((nonnull)) uring_close(struct w_sock * const s);
+
+extern void __attribute__((nonnull)) uring_want_tx(struct w_sock * const s);
+
+extern int __attribute__((nonnull))
+uring_sendmmsg(struct w_sock * const s,
+               struct mmsghdr * const msgvec,
+               const unsigned int vlen);
+#endif
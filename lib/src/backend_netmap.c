@@ -29,10 +29,12 @@
 #include <netinet/in.h>
 #endif
 
+#include <errno.h>
 #include <fcntl.h>
 #include <net/if.h>
 #include <net/netmap_user.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -40,6 +42,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <unistd.h>
 
 #include <net/netmap.h>
@@ -57,20 +60,149 @@
 #include "udp.h"
 
 
+/// Groups of engines that share an interface; see w_engopt::enable_one_ring.
+static sl_head(nm_group_slist, nm_group) groups = sl_head_initializer(groups);
+
+/// Protects @p groups.
+static pthread_mutex_t groups_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/// Add engine @p w to the nm_group of the other engines that each register one
+/// ring of its interface, or to a new group of its own.
+///
+/// @param      w         Backend engine.
+/// @param[in]  one_ring  Whether @p w registers a single ring.
+///
+static void __attribute__((nonnull))
+group_join(struct w_engine * const w, const bool one_ring)
+{
+    ensure(pthread_mutex_lock(&groups_lock) == 0, "pthread_mutex_lock");
+    struct nm_group * g = 0;
+    if (one_ring)
+        sl_foreach (g, &groups, next)
+            if (g->one_ring && strncmp(g->ifname, w->ifname, IFNAMSIZ) == 0)
+                break;
+
+    if (g == 0) {
+        ensure((g = calloc(1, sizeof(*g))) != 0, "cannot allocate nm_group");
+        strncpy(g->ifname, w->ifname, sizeof(g->ifname));
+        g->one_ring = one_ring;
+        ensure(pthread_mutex_init(&g->lock, 0) == 0, "pthread_mutex_init");
+        sl_insert_head(&groups, g, next);
+    }
+
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    sl_insert_head(&g->members, w->b, next);
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+    w->b->grp = g;
+    ensure(pthread_mutex_unlock(&groups_lock) == 0, "pthread_mutex_unlock");
+}
+
+
+/// Remove engine @p w from its nm_group, and free the group (including the
+/// neighbor cache) if @p w was its last member.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) group_leave(struct w_engine * const w)
+{
+    struct nm_group * const g = w->b->grp;
+    ensure(pthread_mutex_lock(&groups_lock) == 0, "pthread_mutex_lock");
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    sl_remove(&g->members, w->b, w_backend, next);
+    const bool last = sl_empty(&g->members);
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+
+    if (last) {
+        sl_remove(&groups, g, nm_group, next);
+        free_neighbor(w);
+        ensure(pthread_mutex_destroy(&g->lock) == 0, "pthread_mutex_destroy");
+        free(g);
+    }
+    ensure(pthread_mutex_unlock(&groups_lock) == 0, "pthread_mutex_unlock");
+    w->b->grp = 0;
+}
+
+
 static void __attribute__((nonnull)) ins_sock(struct w_sock * const s)
 {
-    int ret;
-    const khiter_t k = kh_put(sock, &s->w->b->sock, &s->tup, &ret);
-    assure(ret >= 1, "inserted is %d", ret);
-    kh_val(&s->w->b->sock, k) = s;
+    // other engines in the group look at our w_socks in backend_connect()
+    struct nm_group * const g = s->w->b->grp;
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    flowtab_ins(&s->w->b->sock, s);
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+    s->w->b->rx_sock = 0;
 }
 
 
 static void __attribute__((nonnull)) rem_sock(struct w_sock * const s)
 {
-    const khiter_t k = kh_get(sock, &s->w->b->sock, &s->tup);
-    assure(k != kh_end(&s->w->b->sock), "found");
-    kh_del(sock, &s->w->b->sock, k);
+    struct nm_group * const g = s->w->b->grp;
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    flowtab_del(&s->w->b->sock, s);
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+    s->w->b->rx_sock = 0;
+}
+
+
+/// Return whether any engine in the nm_group of @p w has a w_sock connected to
+/// the given four-tuple, so that connections stay unique on the interface even
+/// when they are spread over the engines of its rings.
+///
+/// @param      w       Backend engine.
+/// @param[in]  local   The local IP address and port.
+/// @param[in]  remote  The remote IP address and port.
+///
+/// @return     Whether the four-tuple is in use.
+///
+static bool __attribute__((nonnull))
+tuple_in_use(struct w_engine * const w,
+             const struct w_sockaddr * const local,
+             const struct w_sockaddr * const remote)
+{
+    struct nm_group * const g = w->b->grp;
+    bool in_use = false;
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    struct w_backend * b;
+    sl_foreach (b, &g->members, next)
+        if (flowtab_get(&b->sock, local, remote)) {
+            in_use = true;
+            break;
+        }
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+    return in_use;
+}
+
+
+/// Check whether a packet with the given four-tuple, which engine @p w has no
+/// w_sock for, would be demultiplexed to a w_sock of another engine in the
+/// group. RSS can steer a flow to a ring other than the one of the engine
+/// that owns its w_sock.
+///
+/// @param      w       Backend engine.
+/// @param[in]  local   The local IP address and port.
+/// @param[in]  remote  The remote IP address and port.
+///
+/// @return     Whether another engine of the group has a matching w_sock.
+///
+bool group_demux(struct w_engine * const w,
+                 const struct w_sockaddr * const local,
+                 const struct w_sockaddr * const remote)
+{
+    struct nm_group * const g = w->b->grp;
+    if (likely(g->one_ring == false))
+        return false;
+
+    bool found = false;
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    struct w_backend * b;
+    sl_foreach (b, &g->members, next)
+        if (b != w->b && flowtab_demux(&b->sock, local, remote)) {
+            found = true;
+            break;
+        }
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+    return found;
 }
 
 
@@ -82,12 +214,29 @@ static void __attribute__((nonnull)) rem_sock(struct w_sock * const s)
 void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
 {
     s->opt = *opt;
+    if (s->__hdr)
+        // the template header depends on the ECN option
+        udp_mk_hdr(s);
+}
+
+
+/// Netmap engines serve RX rings rather than kernel NAPI instances (see
+/// w_engopt::enable_one_ring), so there is no NAPI ID to report.
+///
+/// @param[in]  s     A w_sock.
+///
+/// @return     Zero.
+///
+uint32_t w_napi_id(const struct w_sock * const s __attribute__((unused)))
+{
+    return 0;
 }
 
 
 /// Initialize the warpcore netmap backend for engine @p w. This switches the
-/// interface to netmap mode, maps the underlying buffers into memory and locks
-/// it there, and sets up the extra buffers.
+/// interface (or, with w_engopt::enable_one_ring, one of its rings) to netmap
+/// mode, maps the underlying buffers into memory and locks it there, and sets
+/// up the extra buffers.
 ///
 /// @param      w      Backend engine.
 /// @param[in]  nbufs  Number of packet buffers to allocate.
@@ -98,6 +247,14 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
 
     backend_addr_config(w);
 
+    // netmap pipes only have a single ring pair
+    if (w->is_loopback && w->opt.enable_one_ring) {
+        warn(WRN, "%s is a loopback, ignoring ring %u", w->ifname,
+             w->opt.ring);
+        w->opt.enable_one_ring = false;
+    }
+    group_join(w, w->opt.enable_one_ring);
+
     // open /dev/netmap
     ensure((b->fd = open("/dev/netmap", O_RDWR | O_CLOEXEC)) != -1,
            "cannot open /dev/netmap");
@@ -105,7 +262,7 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
     w->backend_variant =
         w->is_loopback
             ? (w->is_right_pipe ? "right loopback pipe" : "left loopback pipe")
-            : "default";
+            : (w->opt.enable_one_ring ? "single ring" : "default");
 
     // switch interface to netmap mode
     ensure((b->req = calloc(1, sizeof(*b->req))) != 0, "cannot allocate nmreq");
@@ -135,6 +292,12 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
     } else {
         strncpy(b->req->nr_name, w->ifname, sizeof b->req->nr_name);
         b->req->nr_name[sizeof b->req->nr_name - 1] = 0;
+
+        if (w->opt.enable_one_ring) {
+            // only register the given RX and TX ring
+            b->req->nr_flags = NR_REG_ONE_NIC;
+            b->req->nr_ringid |= w->opt.ring & NETMAP_RING_MASK;
+        }
     }
 
     b->req->nr_arg3 = nbufs; // request extra buffers
@@ -153,12 +316,34 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
     // direct pointer to the netmap interface struct for convenience
     b->nif = NETMAP_IF(w->mem, b->req->nr_offset);
 
+    // the interface struct describes all rings, but we only own those we
+    // registered
+    if (w->opt.enable_one_ring) {
+        b->first_ring = w->opt.ring;
+        b->ntxr = b->nrxr = 1;
+        warn(NTE, "%s: using only ring %u", w->ifname, b->first_ring);
+
+        if (w->opt.enable_rss_ports) {
+            // the first engine to need it learns how the NIC steers packets
+            ensure(pthread_mutex_lock(&b->grp->lock) == 0,
+                   "pthread_mutex_lock");
+            if (b->grp->rss.indir_len == 0)
+                rss_init(&b->grp->rss, w->ifname, b->nif->ni_rx_rings);
+            ensure(pthread_mutex_unlock(&b->grp->lock) == 0,
+                   "pthread_mutex_unlock");
+        }
+    } else {
+        b->ntxr = b->nif->ni_tx_rings;
+        b->nrxr = b->nif->ni_rx_rings;
+    }
+
     // allocate space for tails and slot w_iov pointers
     ensure((b->tail = calloc(b->nif->ni_tx_rings, sizeof(*b->tail))) != 0,
            "cannot allocate tail");
     ensure(b->slot_buf = calloc(b->nif->ni_tx_rings, sizeof(*b->slot_buf)),
            "cannot allocate slot w_iov pointers");
-    for (uint32_t ri = 0; likely(ri < b->nif->ni_tx_rings); ri++) {
+    for (uint32_t ri = b->first_ring; likely(ri < b->first_ring + b->ntxr);
+         ri++) {
         const struct netmap_ring * const r = NETMAP_TXRING(b->nif, ri);
         // allocate slot pointers
         ensure(b->slot_buf[ri] = calloc(r->num_slots, sizeof(struct w_iov *)),
@@ -170,7 +355,8 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
     }
 
 #ifndef NDEBUG
-    for (uint32_t ri = 0; likely(ri < b->nif->ni_rx_rings); ri++) {
+    for (uint32_t ri = b->first_ring; likely(ri < b->first_ring + b->nrxr);
+         ri++) {
         const struct netmap_ring * const r = NETMAP_RXRING(b->nif, ri);
         warn(INF, "rx ring %d has %d slots (%d-%d)", ri, r->num_slots,
              r->slot[0].buf_idx, r->slot[r->num_slots - 1].buf_idx);
@@ -178,8 +364,7 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
 #endif
 
     // save the indices of the extra buffers in the warpcore structure
-    w->bufs = calloc(b->req->nr_arg3, sizeof(*w->bufs));
-    ensure(w->bufs != 0, "cannot allocate w_iov");
+    alloc_bufs(w, b->req->nr_arg3);
 
     uint32_t i = b->nif->ni_bufs_head;
     for (uint32_t n = 0; likely(n < b->req->nr_arg3); n++) {
@@ -208,11 +393,11 @@ void backend_cleanup(struct w_engine * const w)
 {
     // close all sockets
     struct w_sock * s;
-    kh_foreach_value(&w->b->sock, s, { w_close(s); });
-    kh_release(sock, &w->b->sock);
+    flowtab_foreach(&w->b->sock, s, { w_close(s); });
+    flowtab_free(&w->b->sock);
 
-    // free ARP cache
-    free_neighbor(w);
+    // leave the group, which frees the ARP cache if we were the last member
+    group_leave(w);
 
     // re-construct the extra bufs list, so netmap can free the memory
     for (uint32_t n = 0; likely(n < sq_len(&w->iov)); n++) {
@@ -234,12 +419,25 @@ void backend_cleanup(struct w_engine * const w)
            "cannot munmap netmap memory");
 
     ensure(close(w->b->fd) != -1, "cannot close /dev/netmap");
-    free(w->bufs);
+    free_bufs(w);
     free(w->b->req);
     free(w->b->tail);
 }
 
 
+/// Grow the buffer pool of engine @p w. Netmap allocates the extra buffers
+/// when the interface is opened, so this is not supported.
+///
+/// @param      w     Backend engine.
+///
+/// @return     False.
+///
+bool backend_grow(struct w_engine * const w __attribute__((unused)))
+{
+    return false;
+}
+
+
 /// Netmap-specific code to bind a warpcore socket. Only computes a random
 /// port number if the socket is not bound to a specific port yet.
 ///
@@ -266,7 +464,7 @@ int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
 }
 
 
-/// The netmap backend performs no operation here.
+/// Remove w_sock @p s from the list of sockets, and free its template header.
 ///
 /// @param      s     The w_sock to close.
 ///
@@ -274,6 +472,9 @@ void backend_close(struct w_sock * const s)
 {
     // remove the socket from list of sockets
     rem_sock(s);
+    if (s->__on_ready)
+        sl_remove(&s->w->b->ready, s, w_sock, __ready);
+    free(s->__hdr);
 }
 
 
@@ -288,6 +489,10 @@ void backend_preconnect(struct w_sock * const s)
 /// address of the destination (or the default router towards it) is not
 /// known, it will block trying to look it up via ARP.
 ///
+/// The local port is changed if the four-tuple is already in use and, with
+/// w_engopt::enable_rss_ports, until the NIC steers the replies to the ring of
+/// this engine.
+///
 /// @param      s     w_sock to connect.
 ///
 /// @return     Zero on success, @p errno otherwise.
@@ -303,19 +508,31 @@ int backend_connect(struct w_sock * const s)
     //                         : s->tup.dip;
     s->dmac = who_has(s->w, &s->ws_raddr);
 
-    // see if we need to update the sport
-    uint8_t n = 200;
+    // see if we need to update the sport; a port that RSS steers to our ring
+    // takes about as many tries as there are rings
+    const struct w_backend * const b = s->w->b;
+    const bool rss = s->w->opt.enable_one_ring && s->w->opt.enable_rss_ports &&
+                     (s->ws_af == AF_INET ? b->grp->rss.ports4
+                                          : b->grp->rss.ports6);
+    uint32_t n = rss ? 200 * b->nif->ni_rx_rings : 200;
+    bool ok = false;
     while (n--) {
-        if (likely(w_get_sock(s->w, &s->ws_loc, &s->ws_rem) == 0))
+        if ((rss == false || rss_ring(&b->grp->rss, &s->ws_rem, &s->ws_loc) ==
+                                 b->first_ring) &&
+            likely(tuple_in_use(s->w, &s->ws_loc, &s->ws_rem) == false)) {
+            ok = true;
             break;
-        // four-tuple exists, reroll sport
+        }
+        // four-tuple exists or is steered elsewhere, reroll sport
         s->ws_lport = pick_local_port();
     }
 
-    if (likely(n))
-        ins_sock(s);
+    if (unlikely(ok == false))
+        return EADDRINUSE;
 
-    return n == 0;
+    ins_sock(s);
+    udp_mk_hdr(s);
+    return 0;
 }
 
 
@@ -330,6 +547,7 @@ int backend_connect(struct w_sock * const s)
 ///
 void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 {
+    s->__tx_ready = false;
     sq_concat(i, &s->iv);
 }
 
@@ -337,7 +555,9 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 /// Loops over the w_iov structures in the w_iov_sq @p o, sending them all
 /// over w_sock @p s. Places the payloads into IPv4 UDP packets, and
 /// attempts to move them into TX rings. Will force a NIC TX if all rings
-/// are full, retry the failed w_iovs. The (last batch of) packets are not
+/// are full, and retry the failed w_iov once. If the rings are still full,
+/// w_tx() stops and sets w_sock::tx_blocked; w_nic_rx() and w_rx_ready() report
+/// @p s once there is ring space again. The (last batch of) packets are not
 /// send yet; w_nic_tx() needs to be called (again) for that. This is, so
 /// that an application has control over exactly when to schedule packet
 /// I/O.
@@ -345,58 +565,168 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 /// @param      s     w_sock socket to transmit over.
 /// @param      o     w_iov_sq to send.
 ///
-void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+/// @return     Number of w_iovs that were not handed off. They are the last
+///             ones in @p o, and can be passed to w_tx() again.
+///
+uint_t w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 {
+    s->__tx_ready = false;
+    uint_t n = w_iov_sq_cnt(o);
     struct w_iov * v;
     sq_foreach (v, o, next) {
         const uint16_t len = v->len;
-        while (unlikely(udp_tx(s, v) == false)) {
+        if (unlikely(udp_tx(s, v) == false)) {
             w_nic_tx(s->w);
             v->len = len;
+            if (udp_tx(s, v) == false) {
+                v->len = len;
+                s->tx_blocked = s->w->b->tx_blocked = true;
+                break;
+            }
         }
+        n--;
     }
+    return n;
 }
 
 
+/// Number of netmap RX slots w_nic_rx() prefetches and processes at once.
+#define RX_BURST 32
+
+
 /// Trigger netmap to make new received data available to w_rx(). Iterates over
-/// any new data in the RX rings, calling eth_rx() for each.
+/// any new data in the RX rings in bursts of up to #RX_BURST slots, calling
+/// eth_rx() for each. If a w_sock is blocked on transmit, also waits for TX
+/// ring space.
+///
+/// At most w_engopt::rx_budget packets are processed per call. The rings are
+/// serviced round-robin, starting after the one where the previous call ran
+/// out of budget. Use w_nic_rx_pending() to find out whether packets may have
+/// been left in the rings; if so, the next call will not wait.
 ///
 /// @param[in]  w     Backend engine.
 /// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
 ///                   for infinite wait.
+/// @param[out] rcvd  If non-zero, set to whether any data is ready for reading
+///                   (rather than only a w_sock having become writable.)
 ///
-/// @return     Whether any data is ready for reading.
+/// @return     Whether any data is ready for reading, or any w_sock has become
+///             writable.
 ///
-bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+bool backend_nic_rx(struct w_engine * const w,
+                    const int64_t nsec,
+                    bool * const rcvd)
 {
-    struct pollfd fds = {.fd = w->b->fd, .events = POLLIN};
+    struct w_backend * const b = w->b;
+    struct pollfd fds = {.fd = b->fd};
 again:
-    if (poll(&fds, 1, nsec < 0 ? -1 : (int)(nsec / NS_PER_MS)) == 0)
+    fds.events = b->tx_blocked ? POLLIN | POLLOUT : POLLIN;
+    // don't wait if the last call left packets in the rings
+    const int64_t to = b->rx_pending ? 0 : nsec;
+#ifdef HAVE_PPOLL
+    struct timespec ts;
+    const int n = ppoll(&fds, 1, timeout_ts(to, &ts), 0);
+#else
+    const int n = poll(&fds, 1, timeout_ms(to));
+#endif
+    if (n == 0) {
+        b->rx_pending = false;
+        if (rcvd)
+            *rcvd = false;
         return false;
+    }
 
-    // loop over all rx rings
     bool rx = false;
-    for (uint32_t i = 0; likely(i < w->b->nif->ni_rx_rings); i++) {
-        struct netmap_ring * const r = NETMAP_RXRING(w->b->nif, i);
-        while (likely(!nm_ring_empty(r))) {
+    bool data = false;
+    if (b->tx_blocked && fds.revents & POLLOUT) {
+        // there is TX ring space again
+        b->tx_blocked = false;
+        struct w_sock * s;
+        flowtab_foreach(&b->sock, s, {
+            if (s->tx_blocked) {
+                s->tx_blocked = false;
+                s->__tx_ready = rx = true;
+                mark_ready(s);
+            }
+        });
+    }
+
+    // loop over all registered rx rings, round-robin
+    const uint32_t nrings = b->nrxr;
+    uint32_t budget = w->opt.rx_budget ? w->opt.rx_budget : UINT32_MAX;
+    b->rx_pending = false;
+    for (uint32_t k = 0; likely(k < nrings); k++) {
+        const uint32_t i = (b->cur_rxr + k) % nrings;
+        struct netmap_ring * const r =
+            NETMAP_RXRING(b->nif, b->first_ring + i);
+        while (likely(!nm_ring_empty(r) && budget)) {
+            const uint32_t n = MIN(MIN(nm_ring_space(r), RX_BURST), budget);
+            uint8_t * buf[RX_BURST];
+            budget -= n;
+
+            // start pulling the headers of the whole burst into the cache
+            uint32_t cur = r->cur;
+            for (uint32_t j = 0; j < n; j++) {
+                buf[j] = (uint8_t *)NETMAP_BUF(r, r->slot[cur].buf_idx);
+                __builtin_prefetch(buf[j]);
+                cur = nm_ring_next(r, cur);
+            }
+
+            // process the slots, which udp_rx() demultiplexes with a lookup
+            // cache that is only valid during this burst
+            b->rx_sock = 0;
+            cur = r->cur;
+            for (uint32_t j = 0; j < n; j++) {
 #if 0
-            warn(DBG, "rx idx %u from ring %u slot %u", r->slot[r->cur].buf_idx,
-                 i, r->cur);
+                warn(DBG, "rx idx %u from ring %u slot %u",
+                     r->slot[cur].buf_idx, i, cur);
 #endif
-            // process the current slot
-            rx = eth_rx(w, &r->slot[r->cur],
-                        (uint8_t *)NETMAP_BUF(r, r->slot[r->cur].buf_idx));
-            r->head = r->cur = nm_ring_next(r, r->cur);
+                data |= eth_rx(w, &r->slot[cur], buf[j]);
+                cur = nm_ring_next(r, cur);
+            }
+            r->head = r->cur = cur;
+        }
+
+        if (unlikely(budget == 0)) {
+            // resume with the next ring, so this one cannot starve the others
+            b->cur_rxr = (i + 1) % nrings;
+            b->rx_pending = true;
+            break;
         }
     }
 
-    if (rx == false && nsec == -1)
+    if (rx == false && data == false && nsec == -1)
         goto again;
 
-    return rx;
+    if (rcvd)
+        *rcvd = data;
+    return rx || data;
 }
 
 
+/// Return whether the last w_nic_rx() call ran out of w_engopt::rx_budget, and
+/// may therefore have left received packets in the RX rings.
+///
+/// @param[in]  w     Backend engine.
+///
+/// @return     Whether w_nic_rx() has more packets to process.
+///
+bool w_nic_rx_pending(const struct w_engine * const w)
+{
+    return w->b->rx_pending;
+}
+
+
+/// The netmap backend transmits directly from the w_iov buffers and does not
+/// hold on to them after w_tx(), so there is never anything to return here.
+///
+/// @param      s     w_sock socket that was transmitted over.
+/// @param      q     w_iov tail queue to append completed w_iovs to.
+///
+void w_tx_done(struct w_sock * const s __attribute__((unused)),
+               struct w_iov_sq * const q __attribute__((unused))) {}
+
+
 /// Push data placed in the TX rings via udp_tx() and similar methods out
 /// onto the link. Also move any transmitted data back into the original
 /// w_iovs.
@@ -412,7 +742,8 @@ void w_nic_tx(struct w_engine * const w)
 
     // grab the transmitted data out of the NIC rings and place it back into
     // the original w_iov_sqs, so it's not lost to the app
-    for (uint32_t i = 0; likely(i < w->b->nif->ni_tx_rings); i++) {
+    for (uint32_t i = w->b->first_ring;
+         likely(i < w->b->first_ring + w->b->ntxr); i++) {
         struct netmap_ring * const r = NETMAP_TXRING(w->b->nif, i);
 #if 0
         rwarn(WRN, 10, "tx ring %u: old tail %u, tail %u, cur %u, head %u", i,
@@ -443,28 +774,45 @@ void w_nic_tx(struct w_engine * const w)
 
 
 /// Fill a w_sock_slist with pointers to some sockets with pending inbound
-/// data. Data can be obtained via w_rx() on each w_sock in the list. Call
-/// can optionally block to wait for at least one ready connection. Will
-/// return the number of ready connections, or zero if none are ready. When
-/// the return value is not zero, a repeated call may return additional
-/// ready sockets.
+/// data, or that have become writable after w_tx() was blocked on them. Data
+/// can be obtained via w_rx() on each w_sock in the list. Call can optionally
+/// block to wait for at least one ready connection. Will return the number of
+/// ready connections, or zero if none are ready. When the return value is not
+/// zero, a repeated call may return additional ready sockets.
+///
+/// Only looks at the w_socks that udp_rx() or w_nic_rx() have put on the ready
+/// list, so the cost does not grow with the number of open w_socks.
 ///
 /// @param[in]  w     Backend engine.
 /// @param      sl    Empty and initialized w_sock_slist.
 ///
-/// @return     Number of connections that are ready for reading.
+/// @return     Number of connections that are ready for reading or writing.
 ///
 uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
 {
-    // insert all sockets with pending inbound data
-    struct w_sock * s;
+    // insert all sockets with pending inbound data or that became writable;
+    // only those on the ready list can qualify, and those that no longer do
+    // are dropped from it
+    struct w_sock_slist * const ready = &w->b->ready;
+    struct w_sock * prev = 0;
+    struct w_sock * s = sl_first(ready);
     uint32_t n = 0;
-    kh_foreach_value(&w->b->sock, s, {
-        if (!sq_empty(&s->iv)) {
+    while (s) {
+        struct w_sock * const nxt = sl_next(s, __ready);
+        if (!sq_empty(&s->iv) || s->__tx_ready) {
+            s->__tx_ready = false;
             sl_insert_head(sl, s, next);
             n++;
+            prev = s;
+        } else {
+            if (prev)
+                sl_remove_after(prev, __ready);
+            else
+                sl_remove_head(ready, __ready);
+            s->__on_ready = false;
         }
-    });
+        s = nxt;
+    }
     return n;
 }
 
@@ -482,9 +830,5 @@ struct w_sock * w_get_sock(struct w_engine * const w,
                            const struct w_sockaddr * const local,
                            const struct w_sockaddr * const remote)
 {
-    struct w_socktuple tup = {.local = *local};
-    if (remote)
-        tup.remote = *remote;
-    const khiter_t k = kh_get(sock, &w->b->sock, &tup);
-    return unlikely(k == kh_end(&w->b->sock)) ? 0 : kh_val(&w->b->sock, k);
+    return flowtab_get(&w->b->sock, local, remote);
 }
@@ -39,6 +39,18 @@ void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
 }
 
 
+/// The RIOT backend has no NAPI instances, so there is no NAPI ID to report.
+///
+/// @param[in]  s     A w_sock.
+///
+/// @return     Zero.
+///
+uint32_t w_napi_id(const struct w_sock * const s)
+{
+    return 0;
+}
+
+
 uint16_t backend_addr_cnt(void)
 {
     gnrc_netif_t * iface = 0;
@@ -107,8 +119,8 @@ done:
 
     ensure((w->mem = calloc(nbufs, max_buf_len(w))) != 0,
            "cannot alloc %" PRIu32 " * %u buf mem", nbufs, max_buf_len(w));
-    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
-           "cannot alloc bufs");
+    alloc_bufs(w, nbufs);
+    w->b->nbufs = nbufs;
 
     for (uint32_t i = 0; i < nbufs; i++) {
         init_iov(w, &w->bufs[i], i);
@@ -127,7 +139,19 @@ void backend_cleanup(struct w_engine * const w)
     sl_foreach (s, &w->b->socks, __next)
         w_close(s);
     free(w->mem);
-    free(w->bufs);
+    free_bufs(w);
+}
+
+
+/// Grow the buffer pool of engine @p w. Not supported with RIOT.
+///
+/// @param      w     Backend engine.
+///
+/// @return     False.
+///
+bool backend_grow(struct w_engine * const w __attribute__((unused)))
+{
+    return false;
 }
 
 
@@ -207,6 +231,9 @@ int backend_connect(struct w_sock * const s)
 ///
 void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 {
+    // return what an earlier w_rx_vec() had no room for first
+    sq_concat(i, &s->iv);
+
     struct w_iov * v = w_alloc_iov(s->w, s->ws_af, 0, 0);
     if (unlikely(v == 0))
         return;
@@ -226,12 +253,14 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 
 
 /// Loops over the w_iov structures in the w_iov_sq @p o, sending them all
-/// over w_sock @p s.
+/// over w_sock @p s. Sends on RIOT block, so all w_iovs are always handed off.
 ///
 /// @param      s     w_sock socket to transmit over.
 /// @param      o     w_iov_sq to send.
 ///
-void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+/// @return     Zero, i.e., the number of w_iovs that were not handed off.
+///
+uint_t w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 {
     const bool is_connected = w_connected(s);
 
@@ -248,6 +277,7 @@ void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
             warn(ERR, "sendto returned %d (%s)", errno, strerror(errno));
         v = sq_next(v, next);
     };
+    return 0;
 }
 
 
@@ -256,10 +286,14 @@ void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 /// @param[in]  w     Backend engine.
 /// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
 ///                   for infinite wait.
+/// @param[out] rcvd  If non-zero, set to whether any data is ready for reading,
+///                   which is the same as the return value.
 ///
 /// @return     Whether any data is ready for reading.
 ///
-bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+bool backend_nic_rx(struct w_engine * const w,
+                    const int64_t nsec,
+                    bool * const rcvd)
 {
     struct w_backend * const b = w->b;
     FD_ZERO(&b->fds);
@@ -273,10 +307,22 @@ bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
 
     b->n = select(MIN(FD_SETSIZE, VFS_MAX_OPEN_FILES) - 1, &b->fds, 0, 0,
                   nsec == -1 ? 0 : &to);
+    if (rcvd)
+        *rcvd = b->n > 0;
     return b->n > 0;
 }
 
 
+/// The RIOT backend does not hold on to w_iovs after w_tx(), so there is
+/// never anything to return here.
+///
+/// @param      s     w_sock socket that was transmitted over.
+/// @param      q     w_iov tail queue to append completed w_iovs to.
+///
+void w_tx_done(struct w_sock * const s __attribute__((unused)),
+               struct w_iov_sq * const q __attribute__((unused))) {}
+
+
 /// Push data placed in the TX rings via udp_tx() and similar methods out
 /// onto the link. Also move any transmitted data back into the original
 /// w_iovs.
@@ -286,6 +332,19 @@ bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
 void w_nic_tx(struct w_engine * const w) {}
 
 
+/// The RIOT backend does not limit how much w_nic_rx() processes per call, so
+/// it never leaves anything pending.
+///
+/// @param[in]  w     Backend engine.
+///
+/// @return     False.
+///
+bool w_nic_rx_pending(const struct w_engine * const w)
+{
+    return false;
+}
+
+
 /// Fill a w_sock_slist with pointers to some sockets with pending inbound
 /// data. Data can be obtained via w_rx() on each w_sock in the list. Call
 /// can optionally block to wait for at least one ready connection. Will
@@ -44,13 +44,34 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
-#ifndef NDEBUG
+#if !defined(NDEBUG) || defined(HAVE_UDP_GRO)
 #include <string.h>
 #endif
 
 #include <warpcore/warpcore.h>
 
+#if defined(HAVE_UDP_GSO) || defined(HAVE_UDP_GRO)
+#include <netinet/udp.h>
+#endif
+
+/// Length of the buffer memory chunks by which backend_grow() extends the pool
+/// (one 2M hugepage.)
+#define CHUNK_LEN (2UL * 1024 * 1024)
+
+/// Minimum interval between backend_shrink() scans of the pool.
+#define SHRINK_IVAL (250 * NS_PER_MS)
+
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+#include <linux/errqueue.h>
+#endif
+
+#ifdef HAVE_REUSEPORT_CBPF
+#include <linux/filter.h>
+#endif
+
 #ifndef PARTICLE
+#include <sys/mman.h>
 #include <sys/uio.h>
 #else
 #define IPV6_TCLASS IP_TOS         // unclear if this works
@@ -64,11 +85,31 @@
 #include <sanitizer/asan_interface.h>
 #endif
 
-#if defined(HAVE_KQUEUE)
+#if defined(WITH_URING)
+// completions are handled in backend_uring.c
+#elif defined(HAVE_KQUEUE)
 #include <sys/event.h>
 #include <time.h>
 #elif defined(HAVE_EPOLL)
 #include <sys/epoll.h>
+#ifdef HAVE_SO_BUSY_POLL
+#include <sys/ioctl.h>
+
+#ifndef EPIOCSPARAMS
+// from linux/eventpoll.h (Linux 6.9), which older headers lack
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+/// Packets to process per epoll busy-poll iteration (the kernel default.)
+#define BUSY_POLL_BUDGET 8
+#endif
 #elif !defined(PARTICLE)
 #include <poll.h>
 #endif
@@ -89,6 +130,124 @@
 #include "ifaddr.h"
 
 
+#if defined(HAVE_UDP_GRO) && !defined(WITH_URING)
+/// Number of UDP GRO super-datagrams to receive per recvmmsg() call.
+#define GRO_SIZE 8
+
+/// Maximum length of a UDP GRO super-datagram.
+#define GRO_BUF_LEN UINT16_MAX
+#endif
+
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+/// Flag in w_zc::cnt marking a send that the kernel has completed.
+#define ZC_DONE 0x80000000
+
+/// Zero-copy transmit state of a w_sock. The kernel numbers MSG_ZEROCOPY sends
+/// consecutively, and reports ranges of completed send IDs on the error queue.
+///
+struct w_zc {
+    struct w_iov_sq pend; ///< Sent w_iovs the kernel may still access.
+    struct w_iov_sq done; ///< Sent w_iovs the kernel is done with.
+    uint32_t * cnt;       ///< Number of w_iovs in each outstanding send.
+    uint32_t head;        ///< ID of the oldest outstanding send.
+    uint32_t tail;        ///< ID of the next send.
+    uint32_t size;        ///< Capacity of @p cnt (a power of two.)
+    /// @cond
+    uint8_t _unused[4]; ///< @internal Padding.
+                        /// @endcond
+};
+#endif
+
+
+#ifndef WITH_URING
+#ifdef HAVE_RECVMMSG
+// There is a tradeoff here in terms of how many messages we should try and
+// receive. Preparing to handle longer sizes has preparation overheads, whereas
+// only handling shorter sizes may require multiple syscalls (and incur their
+// overheads). So each w_sock adapts its batch size between these bounds to
+// what it sees arriving, starting from a number picked out of a hat.
+#define RECV_MIN 4
+#define RECV_INIT MIN(64, IOV_MAX)
+#define RECV_MAX MIN(256, IOV_MAX)
+#define rx_mh(mm, j) (&(mm)->msgvec[j].msg_hdr)
+#else
+#define RECV_MIN 1
+#define RECV_INIT 1
+#define RECV_MAX 1
+#define rx_mh(mm, j) (&(mm)->msgvec[j])
+#endif
+
+/// A receive slot of a w_sock. Its message in w_mmsg::msgvec permanently points
+/// at the fields here, and it holds on to its w_iov between w_rx() calls.
+///
+struct w_rx_slot {
+    struct sockaddr_storage sa; ///< Source address of the received packet.
+    struct iovec msg;           ///< Buffer of @p v.
+    struct w_iov * v;           ///< The w_iov to receive into.
+    /// Control data (TOS and TTL) of the received packet.
+    __extension__ uint8_t
+        ctrl[CMSG_SPACE(sizeof(uint8_t)) + CMSG_SPACE(sizeof(uint8_t))];
+};
+#endif
+
+
+/// Batched I/O state of a w_sock, kept across w_tx() and w_rx() calls so the
+/// message descriptors need not be rebuilt for every call.
+///
+struct w_mmsg {
+#ifndef WITH_URING
+    struct w_rx_slot * slot; ///< Receive slots; [0, armed) hold a w_iov.
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr * msgvec; ///< One receive message per slot.
+#else
+    struct msghdr * msgvec; ///< One receive message per slot.
+#endif
+    uint32_t cap;   ///< Number of allocated slots.
+    uint32_t armed; ///< Number of slots holding a w_iov.
+    uint32_t batch; ///< Number of messages to receive per call.
+#endif
+    struct w_sockaddr tx_dst;      ///< Destination that @p tx_sa is for.
+    struct sockaddr_storage tx_sa; ///< Last destination sent to.
+};
+
+
+/// Return the batched I/O state of w_sock @p s, allocating it on first use.
+///
+/// @param      s     The w_sock.
+///
+/// @return     The w_mmsg of @p s.
+///
+static struct w_mmsg * __attribute__((nonnull)) mmsg(struct w_sock * const s)
+{
+    if (likely(s->__mm))
+        return s->__mm;
+    s->__mm = calloc(1, sizeof(*s->__mm));
+    ensure(s->__mm, "cannot alloc w_mmsg");
+#ifndef WITH_URING
+    s->__mm->batch = RECV_INIT;
+#endif
+    return s->__mm;
+}
+
+
+#ifndef WITH_URING
+/// A kernel socket shared by the w_socks bound to one local address and port,
+/// when w_engopt::enable_virtual_socks is set. Only its internal w_sock is
+/// registered for events, and receives on behalf of all of them.
+///
+struct w_mux {
+    struct w_sock s;           ///< Internal w_sock owning the kernel socket.
+    sl_entry(w_mux) next;      ///< Next w_mux of the engine.
+    struct w_sock_slist socks; ///< The w_socks sharing @p s, newest first.
+    uint32_t refs;             ///< Number of w_socks sharing @p s.
+    /// @cond
+    uint8_t _unused[4]; ///< @internal Padding.
+                        /// @endcond
+};
+#endif
+
+
 /// Set the socket options.
 ///
 /// @param      s     The w_sock to change options for.
@@ -123,12 +282,426 @@ void w_set_sockopt(struct w_sock * const s, const struct w_sockopt * const opt)
             warn(WRN, "cannot setsockopt IP_TOS/IPV6_TCLASS; running on WSL?");
     }
 
+#if defined(HAVE_UDP_GRO) && !defined(WITH_URING)
+    // received packets of virtual w_socks are demultiplexed one by one
+    if (s->__mux == 0 && s->opt.enable_udp_gro != opt->enable_udp_gro) {
+        s->opt.enable_udp_gro = opt->enable_udp_gro;
+        if (unlikely(setsockopt((int)s->fd, SOL_UDP, UDP_GRO,
+                                &(int){s->opt.enable_udp_gro},
+                                sizeof(int)) < 0)) {
+            warn(WRN, "cannot setsockopt UDP_GRO");
+            s->opt.enable_udp_gro = false;
+        } else if (s->opt.enable_udp_gro && s->w->b->gro_buf == 0)
+            ensure((s->w->b->gro_buf = malloc(GRO_SIZE * GRO_BUF_LEN)) != 0,
+                   "cannot alloc GRO buf");
+    }
+#endif
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+    // completions on a shared kernel socket cannot be told apart
+    if (s->__mux == 0 && s->opt.enable_zerocopy != opt->enable_zerocopy) {
+        s->opt.enable_zerocopy = opt->enable_zerocopy;
+        if (unlikely(setsockopt((int)s->fd, SOL_SOCKET, SO_ZEROCOPY,
+                                &(int){s->opt.enable_zerocopy},
+                                sizeof(int)) < 0)) {
+            warn(WRN, "cannot setsockopt SO_ZEROCOPY");
+            s->opt.enable_zerocopy = false;
+        } else if (s->opt.enable_zerocopy && s->__zc == 0) {
+            ensure((s->__zc = calloc(1, sizeof(*s->__zc))) != 0,
+                   "cannot alloc w_zc");
+            sq_init(&s->__zc->pend);
+            sq_init(&s->__zc->done);
+        }
+    }
+#endif
+
+    s->opt.disable_udp_gso = opt->disable_udp_gso;
     s->opt.user_1 = opt->user_1;
     s->opt.user_2 = opt->user_2;
     s->opt.user_3 = opt->user_3;
 }
 
 
+#ifdef HAVE_SO_INCOMING_NAPI_ID
+/// Ask the kernel for the NAPI ID of the device queue that the kernel socket
+/// of w_sock @p s last received from.
+///
+/// @param[in]  s     A w_sock.
+///
+/// @return     NAPI ID, or zero if none.
+///
+static uint32_t __attribute__((nonnull)) napi_id(const struct w_sock * const s)
+{
+    uint32_t id = 0;
+    socklen_t len = sizeof(id);
+    if (getsockopt((int)s->fd, SOL_SOCKET, SO_INCOMING_NAPI_ID, &id, &len) < 0)
+        return 0;
+    return id;
+}
+#endif
+
+
+/// Return the NAPI ID of the device queue that w_sock @p s receives from.
+/// Applications that run several engines on an interface (see
+/// w_engopt::enable_reuseport) can use this to serve the w_socks of one queue
+/// from the same engine, so that w_engopt::busy_poll_us covers all of them.
+///
+/// @param[in]  s     A w_sock.
+///
+/// @return     NAPI ID, or zero if unknown (because nothing was received yet,
+///             the device has no NAPI instances, or the platform has no NAPI
+///             IDs.)
+///
+uint32_t w_napi_id(const struct w_sock * const s
+#ifndef HAVE_SO_INCOMING_NAPI_ID
+                   __attribute__((unused))
+#endif
+)
+{
+#ifdef HAVE_SO_INCOMING_NAPI_ID
+#ifndef WITH_URING
+    if (s->__napi_id)
+        return s->__napi_id == UINT32_MAX ? 0 : s->__napi_id;
+#endif
+    return napi_id(s);
+#else
+    return 0;
+#endif
+}
+
+
+#ifndef PARTICLE
+/// Map @p len bytes of anonymous memory for the packet buffers of engine @p w,
+/// preferably on hugepages to reduce TLB pressure. Tries 1G and 2M hugepages
+/// (if enough are reserved), then transparent hugepages, then normal pages.
+/// The memory is prefaulted, and locked if w_engopt::lock_buf_mem is set.
+///
+/// @param      w       Backend engine.
+/// @param[in]  len     Minimum length of the memory region.
+/// @param[out] mapped  Actual length of the memory region.
+/// @param[in]  init    Whether this is the initial buffer memory (which is
+///                     logged more prominently.)
+///
+/// @return     Pointer to the memory region, or zero on failure.
+///
+static void * __attribute__((nonnull))
+map_buf_mem(const struct w_engine * const w,
+            const size_t len,
+            size_t * const mapped,
+            const bool init)
+{
+    const char * how = "normal pages";
+    void * mem = MAP_FAILED;
+
+#ifdef HAVE_MAP_HUGETLB
+    static const struct {
+        uint8_t shift;
+        const char * name;
+    } huge[] = {{30, "1G hugepages"}, {21, "2M hugepages"}};
+    for (size_t i = 0;
+         w->opt.disable_hugepages == false && i < sizeof(huge) / sizeof(*huge);
+         i++) {
+        const size_t page = 1UL << huge[i].shift;
+        if (len < page / 2)
+            // don't waste more than half of a hugepage
+            continue;
+        *mapped = (len + page - 1) & ~(page - 1);
+        mem = mmap(0, *mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE |
+                       (huge[i].shift << MAP_HUGE_SHIFT),
+                   -1, 0);
+        if (mem != MAP_FAILED) {
+            how = huge[i].name;
+            break;
+        }
+    }
+#endif
+
+    if (mem == MAP_FAILED) {
+        *mapped = len;
+        mem = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+        if (unlikely(mem == MAP_FAILED)) {
+            warn(ERR, "cannot mmap %zu bytes of buf mem (%s)", len,
+                 strerror(errno));
+            return 0;
+        }
+#ifdef HAVE_MADV_HUGEPAGE
+        if (w->opt.disable_hugepages == false &&
+            madvise(mem, len, MADV_HUGEPAGE) == 0)
+            how = "transparent hugepages";
+#endif
+        // prefault (after madvise, so the faults can allocate hugepages)
+        const size_t page = (size_t)getpagesize();
+        for (size_t off = 0; off < len; off += page)
+            ((volatile uint8_t *)mem)[off] = 0;
+    }
+
+    bool locked = false;
+    if (w->opt.lock_buf_mem) {
+        locked = mlock(mem, *mapped) == 0;
+        if (unlikely(locked == false))
+            warn(WRN, "cannot mlock %zu bytes of buf mem (%s)", *mapped,
+                 strerror(errno));
+    }
+
+    if (init)
+        warn(NTE, "%zu bytes of buf mem on %s%s", *mapped, how,
+             locked ? ", locked" : "");
+    else
+        warn(DBG, "%zu bytes of buf mem on %s%s", *mapped, how,
+             locked ? ", locked" : "");
+    return mem;
+}
+#endif
+
+
+/// Grow the buffer pool of engine @p w by one chunk of (hugepage-sized) buffer
+/// memory, unless the pool has reached w_engopt::max_bufs. The new buffers are
+/// placed into w_engine::iov. Must be called without holding the depot lock,
+/// since mapping and prefaulting the chunk takes a while.
+///
+/// @param      w     Backend engine.
+///
+/// @return     True if the pool grew (possibly by another thread), false
+///             otherwise.
+///
+bool backend_grow(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    if (__atomic_test_and_set(&b->resizing, __ATOMIC_ACQUIRE)) {
+        // another thread is already growing (or shrinking) the pool
+        while (__atomic_load_n(&b->resizing, __ATOMIC_ACQUIRE))
+            ;
+        return true;
+    }
+
+    bool grew = false;
+    if (b->nchunks < b->max_chunks) {
+#ifndef PARTICLE
+        uint8_t * const mem =
+            map_buf_mem(w, b->chunk_len, &b->chunk_len, false);
+        if (likely(mem))
+#endif
+        {
+#ifndef PARTICLE
+            // init_iov() looks the chunk up, but it isn't in use until counted
+            b->chunk[b->nchunks] = mem;
+#endif
+            const uint32_t first = b->nbufs + b->nchunks * b->chunk_bufs;
+            struct w_iov_sq q = w_iov_sq_initializer(q);
+            for (uint32_t i = first; i < first + b->chunk_bufs; i++) {
+                init_iov(w, &w->bufs[i], i);
+                sq_insert_head(&q, &w->bufs[i], next);
+                ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
+            }
+
+            depot_lock(w);
+            b->chunk_free[b->nchunks++] = b->chunk_bufs;
+            sq_concat(&w->iov, &q);
+            depot_unlock(w);
+            warn(INF, "grew buf pool to %" PRIu32 " bufs in %" PRIu32 " chunks",
+                 first + b->chunk_bufs, b->nchunks);
+            grew = true;
+        }
+    }
+    __atomic_clear(&b->resizing, __ATOMIC_RELEASE);
+    return grew;
+}
+
+
+/// Release the most recently added chunk of buffer memory of engine @p w back
+/// to the OS, if none of its buffers are in use (or cached by other threads).
+/// To avoid flapping, this keeps at least one chunk's worth of other buffers
+/// free, and only checks every SHRINK_IVAL. The check is a look at the free
+/// counter of the chunk; only releasing the chunk walks the depot, to unlink
+/// its buffers.
+///
+/// @param      w     Backend engine.
+///
+void backend_shrink(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    if (likely(b->nchunks == 0) ||
+        w_iov_sq_cnt(&w->iov) < 2 * (uint_t)b->chunk_bufs)
+        return;
+
+    const uint64_t now = w_now(CLOCK_MONOTONIC);
+    if (now - b->shrink_t < SHRINK_IVAL)
+        return;
+    b->shrink_t = now;
+    if (__atomic_test_and_set(&b->resizing, __ATOMIC_ACQUIRE))
+        return;
+
+    // our own cached w_iovs may be holding on to the chunk
+    w_release_bufs(w);
+    depot_lock(w);
+    const uint32_t first = b->nbufs + (b->nchunks - 1) * b->chunk_bufs;
+    if (b->chunk_free[b->nchunks - 1] < b->chunk_bufs) {
+        depot_unlock(w);
+        __atomic_clear(&b->resizing, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // take the buffers of the chunk out of the pool
+    struct w_iov_sq keep = w_iov_sq_initializer(keep);
+    while (!sq_empty(&w->iov)) {
+        struct w_iov * const x = sq_first(&w->iov);
+        sq_remove_head(&w->iov, next);
+        if (x->idx < first)
+            sq_insert_tail(&keep, x, next);
+    }
+    sq_concat(&w->iov, &keep);
+    b->nchunks--;
+#ifndef PARTICLE
+    uint8_t * const mem = b->chunk[b->nchunks];
+#endif
+    depot_unlock(w);
+
+#ifndef PARTICLE
+    ASAN_UNPOISON_MEMORY_REGION(mem, b->chunk_len);
+    munmap(mem, b->chunk_len);
+#endif
+    __atomic_clear(&b->resizing, __ATOMIC_RELEASE);
+    warn(INF, "shrunk buf pool to %" PRIu32 " bufs in %" PRIu32 " chunks",
+         first, b->nchunks);
+}
+
+
+#ifndef WITH_URING
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+/// Initial number of entries in the event list.
+#define EV_MIN 64
+
+#ifdef HAVE_KQUEUE
+// kqueue reports readability and writability of a w_sock as separate events
+#define EV_PER_SOCK 2
+#else
+#define EV_PER_SOCK 1
+#endif
+
+
+/// Grow the event list of backend @p b, if needed, so that a single kevent() or
+/// epoll_wait() call can report all registered w_socks.
+///
+/// @param      b     Backend.
+///
+static void __attribute__((nonnull)) ev_grow(struct w_backend * const b)
+{
+    const uint32_t need = MAX(EV_MIN, b->nsocks * EV_PER_SOCK);
+    if (likely(need <= b->ev_len))
+        return;
+
+    uint32_t len = MAX(EV_MIN, b->ev_len);
+    while (len < need)
+        len *= 2;
+    void * const ev = realloc(b->ev, len * sizeof(*b->ev));
+    ensure(ev, "cannot alloc %u events", len);
+    b->ev = ev;
+    b->ev_len = len;
+}
+#endif
+
+
+#if defined(HAVE_EPOLL) && !defined(HAVE_KQUEUE)
+/// Register (or re-register) w_sock @p s with epoll, for readability and, if it
+/// is blocked on transmit, for writability.
+///
+/// @param      s     The w_sock.
+/// @param[in]  op    EPOLL_CTL_ADD or EPOLL_CTL_MOD.
+///
+static void __attribute__((nonnull)) ep_arm(struct w_sock * const s,
+                                            const int op)
+{
+    struct epoll_event ev = {
+        .events = EPOLLIN | (s->tx_blocked ? EPOLLOUT : 0) |
+                  (s->w->opt.enable_edge_triggered ? EPOLLET : 0),
+        .data.ptr = s};
+    ensure(epoll_ctl(s->w->b->ep, op, (int)s->fd, &ev) != -1, "epoll_ctl");
+}
+
+
+#ifdef HAVE_SO_BUSY_POLL
+/// Have epoll_wait() on engine @p w busy-poll the device queue for up to
+/// w_engopt::busy_poll_us before it sleeps. Kernels before 6.9 lack
+/// EPIOCSPARAMS, and then only busy-poll epoll when the net.core.busy_poll
+/// sysctl is set.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) ep_busy_poll(struct w_engine * const w)
+{
+    const struct epoll_params p = {
+        .busy_poll_usecs = MIN((uint32_t)INT32_MAX, w->opt.busy_poll_us),
+        .busy_poll_budget = BUSY_POLL_BUDGET,
+        .prefer_busy_poll = w->opt.enable_prefer_busy_poll};
+    if (unlikely(ioctl(w->b->ep, EPIOCSPARAMS, &p) < 0))
+        warn(WRN,
+             "cannot set epoll busy-poll parameters (%s); net.core.busy_poll "
+             "applies",
+             strerror(errno));
+}
+#endif
+
+
+#ifdef HAVE_SO_INCOMING_NAPI_ID
+/// Record which NAPI ID the w_socks that epoll just reported as readable
+/// receive from, the first time for each. Epoll only busy-polls the queue of
+/// one w_sock at a time, so warn when the w_socks of an engine span several
+/// (w_engopt::reuseport_by_queue avoids that.)
+///
+/// @param      b     Backend of the engine.
+///
+static void __attribute__((nonnull)) napi_track(struct w_backend * const b)
+{
+    for (int i = 0; i < b->n; i++) {
+        struct w_sock * const s = b->ev[i].data.ptr;
+        if (likely(s->__napi_id) || (b->ev[i].events & EPOLLIN) == 0)
+            continue;
+
+        // devices without NAPI (such as loopback) report zero
+        const uint32_t id = napi_id(s);
+        s->__napi_id = id ? id : UINT32_MAX;
+        if (id == 0)
+            continue;
+
+        if (b->napi_id == 0)
+            b->napi_id = id;
+        else if (id != b->napi_id)
+            warn(WRN,
+                 "w_sock on port %u receives from NAPI ID %" PRIu32
+                 ", others from %" PRIu32
+                 "; busy-polling covers only one (see reuseport_by_queue)",
+                 bswap16(s->ws_lport), id, b->napi_id);
+    }
+}
+#endif
+#endif
+
+
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+/// Have w_rx_ready() report an edge-triggered w_sock @p s again, because w_rx()
+/// stopped reading it before the kernel ran out of data. (Re-registering makes
+/// the kernel check the current state.)
+///
+/// @param      s     The w_sock.
+///
+static void __attribute__((nonnull)) rx_rearm(struct w_sock * const s)
+{
+    if (s->w->opt.enable_edge_triggered == false)
+        return;
+#if defined(HAVE_KQUEUE)
+    struct kevent ev;
+    EV_SET(&ev, s->fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, s);
+    ensure(kevent(s->w->b->kq, &ev, 1, 0, 0, 0) != -1, "kevent");
+#else
+    ep_arm(s, EPOLL_CTL_MOD);
+#endif
+}
+#endif
+#endif
+
+
 /// Initialize the warpcore socket backend for engine @p w. Sets up the extra
 /// buffers.
 ///
@@ -143,10 +716,30 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
     w->mtu = MIN(w->mtu, (uint16_t)getpagesize() / 2);
 #endif
 
+#ifndef PARTICLE
+    w->mem = map_buf_mem(w, (size_t)nbufs * max_buf_len(w), &w->b->mem_len, true);
+    ensure(w->mem, "cannot map %" PRIu32 " * %u buf mem", nbufs,
+           max_buf_len(w));
+
+    // the pool can grow in chunks up to max_bufs; reserve w_iovs for all of
+    // them, so buffer indices stay contiguous (alloc_bufs() doesn't touch them
+    // until used)
+    w->b->chunk_len = CHUNK_LEN;
+    w->b->chunk_bufs = (uint32_t)(CHUNK_LEN / max_buf_len(w));
+    if (w->opt.max_bufs > nbufs)
+        w->b->max_chunks = (w->opt.max_bufs - nbufs + w->b->chunk_bufs - 1) /
+                           w->b->chunk_bufs;
+    if (w->b->max_chunks) {
+        w->b->chunk = calloc(w->b->max_chunks, sizeof(*w->b->chunk));
+        w->b->chunk_free = calloc(w->b->max_chunks, sizeof(*w->b->chunk_free));
+        ensure(w->b->chunk && w->b->chunk_free, "cannot alloc chunks");
+    }
+#else
     ensure((w->mem = calloc(nbufs, max_buf_len(w))) != 0,
            "cannot alloc %" PRIu32 " * %u buf mem", nbufs, max_buf_len(w));
-    ensure((w->bufs = calloc(nbufs, sizeof(*w->bufs))) != 0,
-           "cannot alloc bufs");
+#endif
+    w->b->nbufs = nbufs;
+    alloc_bufs(w, nbufs + w->b->max_chunks * w->b->chunk_bufs);
     w->backend_name = "socket";
 
     for (uint32_t i = 0; i < nbufs; i++) {
@@ -155,16 +748,35 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
         ASAN_POISON_MEMORY_REGION(w->bufs[i].buf, max_buf_len(w));
     }
 
-#if defined(HAVE_KQUEUE)
+#if defined(WITH_URING)
+    uring_init(w, nbufs);
+    w->backend_variant = "io_uring/sendmsg/recvmsg";
+#elif defined(HAVE_KQUEUE)
     w->b->kq = kqueue();
+    ev_grow(w->b);
     w->backend_variant = "kqueue/" SENDFUNC "/" RECVFUNC;
 #elif defined(HAVE_EPOLL)
     w->b->ep = epoll_create1(0);
+    ev_grow(w->b);
+#ifdef HAVE_SO_BUSY_POLL
+    if (w->opt.busy_poll_us)
+        ep_busy_poll(w);
+#endif
     w->backend_variant = "epoll/" SENDFUNC "/" RECVFUNC;
 #else
     w->backend_variant = "poll/" SENDFUNC "/" RECVFUNC;
 #endif
 
+#ifdef HAVE_UDP_GSO
+    // see if the kernel supports UDP GSO; older ones fail with ENOPROTOOPT
+    const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    w->b->gso = fd >= 0 && setsockopt(fd, SOL_UDP, UDP_SEGMENT, &(int){0},
+                                      sizeof(int)) == 0;
+    if (fd >= 0)
+        close(fd);
+    warn(DBG, "kernel %s UDP GSO", w->b->gso ? "supports" : "does not support");
+#endif
+
     warn(DBG, "%s backend using %s", w->backend_name, w->backend_variant);
 }
 
@@ -175,38 +787,147 @@ void backend_init(struct w_engine * const w, const uint32_t nbufs)
 ///
 void backend_cleanup(struct w_engine * const w)
 {
-#if !defined(HAVE_KQUEUE) && !defined(HAVE_EPOLL)
+#ifndef WITH_URING
+    // close the kernel sockets that virtual w_socks still share
+    while (!sl_empty(&w->b->mux)) {
+        struct w_mux * const m = sl_first(&w->b->mux);
+        sl_remove_head(&w->b->mux, next);
+        backend_close(&m->s);
+        free(m);
+    }
+    flowtab_free(&w->b->vsock);
+#endif
+#if defined(WITH_URING)
+    uring_cleanup(w);
+#elif defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+    free(w->b->ev);
+    w->b->ev = 0;
+    w->b->ev_len = 0;
+#else
+    while (w->b->nfds)
+        w_close(w->b->fds_sock[w->b->nfds - 1]);
     free(w->b->fds);
+    free(w->b->fds_sock);
     w->b->fds = 0;
-    struct w_sock * s;
-    sl_foreach (s, &w->b->socks, __next)
-        w_close(s);
+    w->b->fds_sock = 0;
+    w->b->fds_len = 0;
 #endif
+#ifdef HAVE_UDP_GRO
+    free(w->b->gro_buf);
+    w->b->gro_buf = 0;
+#endif
+#ifndef PARTICLE
+    while (w->b->nchunks) {
+        uint8_t * const mem = w->b->chunk[--w->b->nchunks];
+        ASAN_UNPOISON_MEMORY_REGION(mem, w->b->chunk_len);
+        munmap(mem, w->b->chunk_len);
+    }
+    free(w->b->chunk);
+    free(w->b->chunk_free);
+    ASAN_UNPOISON_MEMORY_REGION(w->mem, w->b->mem_len);
+    munmap(w->mem, w->b->mem_len);
+#else
     free(w->mem);
-    free(w->bufs);
+#endif
+    free_bufs(w);
     w->b->n = 0;
 }
 
 
-/// Bind a warpcore socket-backend socket. Calls the underlying Socket API.
+#ifdef HAVE_REUSEPORT_CBPF
+/// Attach a classic BPF program to the SO_REUSEPORT group of w_sock @p s that
+/// steers each packet to the group member whose index is the CPU (or, with
+/// w_engopt::reuseport_by_queue, the device RX queue) the packet was received
+/// on, modulo w_engopt::reuseport_engines.
+///
+/// @param      s     A w_sock bound with SO_REUSEPORT.
+///
+static void __attribute__((nonnull)) steer(const struct w_sock * const s)
+{
+    const uint32_t ad =
+        s->w->opt.reuseport_by_queue ? SKF_AD_QUEUE : SKF_AD_CPU;
+    struct sock_filter code[] = {
+        // A = the CPU or RX queue the packet was received on
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)SKF_AD_OFF + ad},
+        // A %= number of engines
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, MAX(1, s->w->opt.reuseport_engines)},
+        // return A as the index of the group member
+        {BPF_RET | BPF_A, 0, 0, 0}};
+    const struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]), .filter = code};
+    ensure(setsockopt((int)s->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                      sizeof(prog)) >= 0,
+           "cannot setsockopt SO_ATTACH_REUSEPORT_CBPF");
+}
+#endif
+
+
+#ifdef HAVE_SO_BUSY_POLL
+/// Have the kernel busy-poll the device queue when the kernel socket of w_sock
+/// @p s would otherwise sleep, per w_engopt::busy_poll_us and
+/// w_engopt::enable_prefer_busy_poll. Going beyond the system defaults needs
+/// CAP_NET_ADMIN, so failing to is not fatal, and only warned about once.
+///
+/// @param[in]  s     The w_sock.
+///
+static void __attribute__((nonnull)) busy_poll(const struct w_sock * const s)
+{
+    static bool warned = false;
+    const int us = (int)MIN((uint32_t)INT_MAX, s->w->opt.busy_poll_us);
+    if (unlikely(setsockopt((int)s->fd, SOL_SOCKET, SO_BUSY_POLL, &us,
+                            sizeof(us)) < 0) &&
+        __atomic_exchange_n(&warned, true, __ATOMIC_RELAXED) == false)
+        warn(WRN, "cannot setsockopt SO_BUSY_POLL: %s", strerror(errno));
+#ifdef HAVE_SO_PREFER_BUSY_POLL
+    if (s->w->opt.enable_prefer_busy_poll &&
+        unlikely(setsockopt((int)s->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                            &(int){1}, sizeof(int)) < 0) &&
+        __atomic_exchange_n(&warned, true, __ATOMIC_RELAXED) == false)
+        warn(WRN, "cannot setsockopt SO_PREFER_BUSY_POLL: %s",
+             strerror(errno));
+#endif
+}
+#endif
+
+
+/// Create, bind and register the kernel socket of w_sock @p s.
 ///
 /// @param      s     The w_sock to bind.
 /// @param[in]  opt   Socket options for this socket. Can be zero.
 ///
 /// @return     Zero on success, @p errno otherwise.
 ///
-int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
+static int __attribute__((nonnull(1)))
+sock_bind(struct w_sock * const s, const struct w_sockopt * const opt)
 {
     s->fd = socket(s->ws_af, SOCK_DGRAM | SOCK_CLOEXEC, 0);
     if (unlikely(s->fd < 0))
         return errno;
 
+#ifdef HAVE_SO_REUSEPORT
+    if (s->w->opt.enable_reuseport)
+        ensure(setsockopt((int)s->fd, SOL_SOCKET, SO_REUSEPORT, &(int){1},
+                          sizeof(int)) >= 0,
+               "cannot setsockopt SO_REUSEPORT");
+#endif
+
+#ifdef HAVE_SO_BUSY_POLL
+    if (s->w->opt.busy_poll_us)
+        busy_poll(s);
+#endif
+
     struct sockaddr_storage ss;
     to_sockaddr((struct sockaddr *)&ss, &s->ws_laddr, s->ws_lport, s->ws_scope);
     if (unlikely(bind((int)s->fd, (struct sockaddr *)&ss, sa_len(s->ws_af)) !=
                  0))
         return errno;
 
+#ifdef HAVE_REUSEPORT_CBPF
+    if (s->w->opt.enable_reuseport &&
+        (s->w->opt.reuseport_by_cpu || s->w->opt.reuseport_by_queue))
+        steer(s);
+#endif
+
     // enable always receiving TOS information
     ensure(setsockopt((int)s->fd,
                       s->ws_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6,
@@ -252,71 +973,470 @@ int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
         s->ws_lport = sa_port(&ss);
     }
 
-#if defined(HAVE_KQUEUE)
+#if defined(WITH_URING)
+    uring_bind(s);
+#elif defined(HAVE_KQUEUE)
     struct kevent ev;
-    EV_SET(&ev, s->fd, EVFILT_READ, EV_ADD, 0, 0, s);
+    EV_SET(&ev, s->fd, EVFILT_READ,
+           EV_ADD | (s->w->opt.enable_edge_triggered ? EV_CLEAR : 0), 0, 0, s);
     ensure(kevent(s->w->b->kq, &ev, 1, 0, 0, 0) != -1, "kevent");
+    s->w->b->nsocks++;
+    ev_grow(s->w->b);
 #elif defined(HAVE_EPOLL)
-    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = s};
-    ensure(epoll_ctl(s->w->b->ep, EPOLL_CTL_ADD, (int)s->fd, &ev) != -1,
-           "epoll_ctl");
+    ep_arm(s, EPOLL_CTL_ADD);
+    s->w->b->nsocks++;
+    ev_grow(s->w->b);
 #else
-    sl_insert_head(&s->w->b->socks, s, __next);
+    struct w_backend * const b = s->w->b;
+    if (unlikely(b->nfds == b->fds_len)) {
+        const uint32_t len = b->fds_len ? b->fds_len * 2 : 16;
+        struct pollfd * const fds = realloc(b->fds, len * sizeof(*fds));
+        ensure(fds, "cannot alloc %u pollfds", len);
+        b->fds = fds;
+        struct w_sock ** const fds_sock =
+            realloc(b->fds_sock, len * sizeof(*fds_sock));
+        ensure(fds_sock, "cannot alloc %u pollfds", len);
+        b->fds_sock = fds_sock;
+        b->fds_len = len;
+    }
+    s->__pfd = b->nfds++;
+    b->fds[s->__pfd] = (struct pollfd){.fd = (int)s->fd, .events = POLLIN};
+    b->fds_sock[s->__pfd] = s;
 #endif
 
     return 0;
 }
 
 
-void backend_preconnect(struct w_sock * const s __attribute__((unused))) {}
+#ifndef WITH_URING
+/// Have the unconnected w_sock of w_mux @p m that was bound first receive what
+/// no connected w_sock claims, unless an unconnected one already does. Called
+/// whenever that w_sock may have connected or closed, so that unclaimed
+/// packets are only dropped when there is no unconnected w_sock left.
+///
+/// @param      m     A w_mux.
+///
+static void __attribute__((nonnull)) mux_promote(struct w_mux * const m)
+{
+    struct flowtab * const ft = &m->s.w->b->vsock;
+    if (flowtab_get(ft, &m->s.ws_loc, 0))
+        return;
+
+    struct w_sock * s;
+    struct w_sock * first = 0;
+    sl_foreach (s, &m->socks, __next)
+        if (w_connected(s) == false)
+            first = s;
+    if (first)
+        flowtab_ins(ft, first);
+}
 
 
-/// The socket backend performs no operation here.
+/// Bind virtual w_sock @p s. Shares the kernel socket of an earlier w_sock
+/// bound to the same local address and port, or creates one.
 ///
-/// @param      s     The w_sock to connect.
+/// @param      s     The w_sock to bind.
+/// @param[in]  opt   Socket options for this socket. Can be zero.
 ///
 /// @return     Zero on success, @p errno otherwise.
 ///
-int backend_connect(struct w_sock * const s)
+static int __attribute__((nonnull(1)))
+mux_bind(struct w_sock * const s, const struct w_sockopt * const opt)
 {
-    struct sockaddr_storage ss;
-    to_sockaddr((struct sockaddr *)&ss, &s->ws_raddr, s->ws_rport, s->ws_scope);
-    if (unlikely(connect((int)s->fd, (struct sockaddr *)&ss,
-                         sa_len(ss.ss_family)) != 0))
-        return errno;
+    struct w_backend * const b = s->w->b;
+    struct w_mux * m = 0;
+    if (s->ws_lport)
+        sl_foreach (m, &b->mux, next)
+            if (w_sockaddr_cmp(&m->s.ws_loc, &s->ws_loc))
+                break;
+
+    if (m == 0) {
+        m = calloc(1, sizeof(*m));
+        if (unlikely(m == 0))
+            return ENOMEM;
+        m->s.w = s->w;
+        m->s.ws_loc = s->ws_loc;
+        m->s.ws_scope = s->ws_scope;
+        sq_init(&m->s.iv);
+        const int e = sock_bind(&m->s, opt);
+        if (unlikely(e)) {
+            free(m);
+            return e;
+        }
+        sl_insert_head(&b->mux, m, next);
+    }
+
+    m->refs++;
+    sl_insert_head(&m->socks, s, __next);
+    s->__mux = m;
+    s->fd = m->s.fd;
+    s->ws_lport = m->s.ws_lport;
+    if (opt)
+        w_set_sockopt(s, opt);
+
+    // the first unconnected w_sock receives what no connected one claims
+    mux_promote(m);
     return 0;
 }
 
 
-/// Close the socket.
+/// Close virtual w_sock @p s, and the kernel socket it shares when it is the
+/// last one using it.
 ///
 /// @param      s     The w_sock to close.
 ///
-void backend_close(struct w_sock * const s)
+static void __attribute__((nonnull)) mux_close(struct w_sock * const s)
 {
-#if defined(HAVE_KQUEUE)
-    struct kevent ev;
+    struct w_backend * const b = s->w->b;
+    if (flowtab_get(&b->vsock, &s->ws_loc,
+                    w_connected(s) ? &s->ws_rem : 0) == s)
+        flowtab_del(&b->vsock, s);
+    if (s->__on_ready)
+        sl_remove(&b->ready, s, w_sock, __ready);
+    // a virtual w_sock only uses its w_mmsg for the TX destination
+    free(s->__mm);
+
+    struct w_mux * const m = s->__mux;
+    sl_remove(&m->socks, s, w_sock, __next);
+    if (--m->refs) {
+        mux_promote(m);
+        return;
+    }
+    sl_remove(&b->mux, m, w_mux, next);
+    backend_close(&m->s);
+    free(m);
+}
+#endif
+
+
+/// Bind a warpcore socket-backend socket. Calls the underlying Socket API.
+///
+/// @param      s     The w_sock to bind.
+/// @param[in]  opt   Socket options for this socket. Can be zero.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int backend_bind(struct w_sock * const s, const struct w_sockopt * const opt)
+{
+#ifndef WITH_URING
+    if (s->w->opt.enable_virtual_socks)
+        return mux_bind(s, opt);
+#endif
+    return sock_bind(s, opt);
+}
+
+
+/// Stop demultiplexing packets to a virtual w_sock by its local address and
+/// port, before it is connected.
+///
+/// @param      s     The w_sock to connect.
+///
+void backend_preconnect(struct w_sock * const s
+#ifdef WITH_URING
+                        __attribute__((unused))
+#endif
+)
+{
+#ifndef WITH_URING
+    if (s->__mux && flowtab_get(&s->w->b->vsock, &s->ws_loc, 0) == s)
+        flowtab_del(&s->w->b->vsock, s);
+#endif
+}
+
+
+/// Connect a socket-backend socket. A virtual w_sock is not connected in the
+/// kernel, but demultiplexed by its four-tuple and sent from with an explicit
+/// destination. If it received what no connected w_sock claims, the next
+/// unconnected w_sock sharing its kernel socket does so from now on.
+///
+/// @param      s     The w_sock to connect.
+///
+/// @return     Zero on success, @p errno otherwise.
+///
+int backend_connect(struct w_sock * const s)
+{
+#ifndef WITH_URING
+    if (s->__mux) {
+        if (flowtab_get(&s->w->b->vsock, &s->ws_loc, &s->ws_rem)) {
+            // stay unconnected, and take over unclaimed packets again
+            memset(&s->ws_rem, 0, sizeof(s->ws_rem));
+            mux_promote(s->__mux);
+            return EADDRINUSE;
+        }
+        flowtab_ins(&s->w->b->vsock, s);
+        // hand unclaimed packets to the next unconnected w_sock
+        mux_promote(s->__mux);
+        struct w_mmsg * const mm = mmsg(s);
+        to_sockaddr((struct sockaddr *)&mm->tx_sa, &s->ws_raddr, s->ws_rport,
+                    s->ws_scope);
+        mm->tx_dst = s->ws_rem;
+        return 0;
+    }
+#endif
+    struct sockaddr_storage ss;
+    to_sockaddr((struct sockaddr *)&ss, &s->ws_raddr, s->ws_rport, s->ws_scope);
+    if (unlikely(connect((int)s->fd, (struct sockaddr *)&ss,
+                         sa_len(ss.ss_family)) != 0))
+        return errno;
+    return 0;
+}
+
+
+/// Close the socket.
+///
+/// @param      s     The w_sock to close.
+///
+void backend_close(struct w_sock * const s)
+{
+#ifndef WITH_URING
+    if (s->__mux) {
+        mux_close(s);
+        return;
+    }
+#endif
+#if defined(WITH_URING)
+    uring_close(s);
+#elif defined(HAVE_KQUEUE)
+    struct kevent ev;
     EV_SET(&ev, s->fd, EVFILT_READ, EV_DELETE, 0, 0, s);
     ensure(kevent(s->w->b->kq, &ev, 1, 0, 0, 0) != -1, "kevent");
+    s->w->b->nsocks--;
 #elif defined(HAVE_EPOLL)
     struct epoll_event ev = {.events = EPOLLIN, .data.ptr = s};
     ensure(epoll_ctl(s->w->b->ep, EPOLL_CTL_DEL, (int)s->fd, &ev) != -1,
            "epoll_ctl");
+    s->w->b->nsocks--;
 #else
-    sl_remove(&s->w->b->socks, s, w_sock, __next);
+    // move the last pollfd into the hole, so the set stays dense
+    struct w_backend * const b = s->w->b;
+    const uint32_t last = --b->nfds;
+    if (s->__pfd != last) {
+        b->fds[s->__pfd] = b->fds[last];
+        b->fds_sock[s->__pfd] = b->fds_sock[last];
+        b->fds_sock[s->__pfd]->__pfd = s->__pfd;
+    }
 #endif
 
     ensure(close((int)s->fd) == 0, "close");
+
+    if (s->__mm) {
+#ifndef WITH_URING
+        for (uint32_t j = 0; j < s->__mm->armed; j++)
+            w_free_iov(s->__mm->slot[j].v);
+        s->w->b->rx_pinned -= s->__mm->armed;
+        free(s->__mm->slot);
+        free(s->__mm->msgvec);
+#endif
+        free(s->__mm);
+    }
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+    if (s->__zc) {
+        // the socket is gone, so whatever the kernel still holds is dropped
+        w_free(&s->__zc->pend);
+        w_free(&s->__zc->done);
+        free(s->__zc->cnt);
+        free(s->__zc);
+    }
+#endif
 }
 
 
-/// Loops over the w_iov structures in the tail queue @p o, sending them all
-/// over w_sock @p s. This backend uses the Socket API.
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+/// Move @p n w_iovs from the head of tail queue @p from to the tail of @p to.
+///
+/// @param      from  Source tail queue.
+/// @param      to    Destination tail queue.
+/// @param[in]  n     Number of w_iovs to move.
+///
+static void __attribute__((nonnull))
+move_iovs(struct w_iov_sq * const from,
+          struct w_iov_sq * const to,
+          const uint32_t n)
+{
+    for (uint32_t j = 0; j < n; j++) {
+        struct w_iov * const v = sq_first(from);
+        sq_remove_head(from, next);
+        sq_insert_tail(to, v, next);
+    }
+}
+
+
+/// Account for a sendmmsg() call with MSG_ZEROCOPY on w_sock @p s. The w_iovs
+/// of the @p sent messages that went out move from the head of @p q to the
+/// pending w_iovs of @p s. The kernel never saw those of the @p failed messages
+/// after them, so they move straight to w_zc::done.
+///
+/// @param      s       The w_sock that was sent on.
+/// @param      q       Tail queue of w_iovs being sent.
+/// @param[in]  msgvec  The messages passed to sendmmsg().
+/// @param[in]  sent    Number of messages the kernel accepted.
+/// @param[in]  failed  Number of messages that failed.
+///
+static void __attribute__((nonnull))
+zc_sent(struct w_sock * const s,
+        struct w_iov_sq * const q,
+        const struct mmsghdr * const msgvec,
+        const size_t sent,
+        const size_t failed)
+{
+    struct w_zc * const zc = s->__zc;
+    for (size_t j = 0; j < sent; j++) {
+        if (unlikely(zc->tail - zc->head == zc->size)) {
+            // grow the ring, keeping entries at their ID modulo the new size
+            const uint32_t size = zc->size ? zc->size * 2 : 64;
+            uint32_t * const cnt = calloc(size, sizeof(*cnt));
+            ensure(cnt, "cannot alloc w_zc cnt");
+            for (uint32_t id = zc->head; id != zc->tail; id++)
+                cnt[id & (size - 1)] = zc->cnt[id & (zc->size - 1)];
+            free(zc->cnt);
+            zc->cnt = cnt;
+            zc->size = size;
+        }
+        const uint32_t n = (uint32_t)msgvec[j].msg_hdr.msg_iovlen;
+        zc->cnt[zc->tail++ & (zc->size - 1)] = n;
+        move_iovs(q, &zc->pend, n);
+    }
+    for (size_t j = sent; j < sent + failed; j++)
+        move_iovs(q, &zc->done, (uint32_t)msgvec[j].msg_hdr.msg_iovlen);
+}
+
+
+/// Read the MSG_ZEROCOPY completion notifications of w_sock @p s from its error
+/// queue, and move the w_iovs of completed sends to w_zc::done. Sends are
+/// released in the order they were made.
+///
+/// @param      s     The w_sock.
+///
+static void __attribute__((nonnull)) zc_reap(struct w_sock * const s)
+{
+    struct w_zc * const zc = s->__zc;
+    if (zc == 0 || zc->head == zc->tail)
+        return;
+
+    const uint32_t mask = zc->size - 1;
+    for (;;) {
+        __extension__ uint8_t ctrl[CMSG_SPACE(
+            sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr mh = {.msg_control = ctrl,
+                            .msg_controllen = sizeof(ctrl)};
+        if (recvmsg((int)s->fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (unlikely(errno != EAGAIN))
+                warn(ERR, "recvmsg MSG_ERRQUEUE returned %d (%s)", errno,
+                     strerror(errno));
+            break;
+        }
+
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&mh); cmsg;
+             cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+            if ((cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) &&
+                (cmsg->cmsg_level != SOL_IPV6 ||
+                 cmsg->cmsg_type != IPV6_RECVERR))
+                continue;
+            const struct sock_extended_err * const ee =
+                (void *)CMSG_DATA(cmsg);
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0)
+                continue;
+            // ee_info to ee_data is the (inclusive) range of completed IDs
+            for (uint32_t id = ee->ee_info; id != ee->ee_data + 1; id++)
+                if (likely(id - zc->head < zc->tail - zc->head))
+                    zc->cnt[id & mask] |= ZC_DONE;
+        }
+    }
+
+    while (zc->head != zc->tail && zc->cnt[zc->head & mask] & ZC_DONE)
+        move_iovs(&zc->pend, &zc->done,
+                  zc->cnt[zc->head++ & mask] & ~(uint32_t)ZC_DONE);
+}
+#endif
+
+
+#ifdef HAVE_UDP_GSO
+/// Maximum number of segments the kernel accepts in one UDP GSO send (older
+/// kernels limit UDP_MAX_SEGMENTS to this value.)
+#define GSO_MAX_SEGS 64
+
+/// Maximum number of segments in one UDP GSO send with MSG_ZEROCOPY. The kernel
+/// fails those with EMSGSIZE if they span more than MAX_SKB_FRAGS (17) pages,
+/// and each w_iov can span two.
+#define GSO_MAX_SEGS_ZC 8
+
+/// Maximum total payload of one UDP GSO super-datagram.
+#define GSO_MAX_LEN (UINT16_MAX - 28) // 28 = IP4 + UDP hdr
+
+#define GSO_CMSG_SPACE CMSG_SPACE(sizeof(uint16_t))
+#else
+#define GSO_CMSG_SPACE 0
+#endif
+
+
+/// Mark w_sock @p s as blocked on transmit, and ask to be notified when it
+/// becomes writable again.
+///
+/// @param      s     The w_sock whose send buffer is full.
+///
+static void __attribute__((nonnull)) tx_block(struct w_sock * const s)
+{
+    if (s->tx_blocked)
+        return;
+    s->tx_blocked = true;
+
+#ifndef WITH_URING
+    if (s->__mux) {
+        // wait for the shared kernel socket instead
+        tx_block(&s->__mux->s);
+        return;
+    }
+#endif
+
+#if defined(WITH_URING)
+    uring_want_tx(s);
+#elif defined(HAVE_KQUEUE)
+    struct kevent ev;
+    EV_SET(&ev, s->fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT, 0, 0, s);
+    ensure(kevent(s->w->b->kq, &ev, 1, 0, 0, 0) != -1, "kevent");
+#elif defined(HAVE_EPOLL)
+    ep_arm(s, EPOLL_CTL_MOD);
+#else
+    s->w->b->fds[s->__pfd].events = POLLIN | POLLOUT;
+#endif
+}
+
+
+/// Return the w_iov to send after @p v: the next one in its tail queue, or if
+/// @p vec is non-zero, the one after index @p k in @p vec (advancing @p k.)
+///
+/// @param[in]  vec   w_iov_vec being sent, or zero.
+/// @param[in]  v     Current w_iov.
+/// @param      k     Index of @p v in @p vec.
+///
+/// @return     Next w_iov, or zero at the end.
+///
+static inline struct w_iov * __attribute__((nonnull(2, 3), always_inline))
+tx_next(const struct w_iov_vec * const vec,
+        const struct w_iov * const v,
+        uint32_t * const k)
+{
+    if (vec)
+        return ++*k < vec->cnt ? vec->v[*k] : 0;
+    return sq_next(v, next);
+}
+
+
+/// Send the w_iovs in tail queue @p o, or if @p vec is non-zero, those in
+/// @p vec, over w_sock @p s; see w_tx() and w_tx_vec(). The messages are
+/// filled directly from whichever holds the w_iovs.
 ///
 /// @param      s     w_sock socket to transmit over.
-/// @param      o     w_iov_sq to send.
+/// @param      o     w_iov_sq to send, unless @p vec is non-zero.
+/// @param[in]  vec   w_iov_vec to send, or zero. MSG_ZEROCOPY must be off.
 ///
-void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
+/// @return     Number of w_iovs that were not handed off.
+///
+static uint_t __attribute__((nonnull(1)))
+tx(struct w_sock * const s,
+   struct w_iov_sq * const o,
+   const struct w_iov_vec * const vec)
 {
 #ifdef HAVE_SENDMMSG
 // There is a tradeoff here in terms of how many messages we should try and
@@ -332,122 +1452,389 @@ void w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 #endif
     struct iovec msg[SEND_SIZE];
     struct sockaddr_storage sa[SEND_SIZE];
+    struct w_iov * first[SEND_SIZE]; // first w_iov in each message
+    uint32_t first_k[SEND_SIZE];     // and its index into vec
 #ifdef __linux__
     // kernels below 4.9 can't deal with getting an uint8_t passed in, sigh
-    __extension__ uint8_t ctrl[SEND_SIZE][CMSG_SPACE(sizeof(int))];
+    __extension__ uint8_t
+        ctrl[SEND_SIZE][CMSG_SPACE(sizeof(int)) + GSO_CMSG_SPACE];
 #else
     __extension__ uint8_t ctrl[SEND_SIZE][CMSG_SPACE(sizeof(uint8_t))];
 #endif
 
-    struct w_iov * v = sq_first(o);
-    do {
-        size_t i;
-        for (i = 0; i < SEND_SIZE && v; i++) {
+    const uint_t cnt = vec ? vec->cnt : w_iov_sq_cnt(o);
+    uint32_t k = 0; // index of v into vec
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+    // with zero-copy, take the w_iovs out of o as we go
+    const bool zc = s->opt.enable_zerocopy;
+    const int flags = MSG_DONTWAIT | (zc ? MSG_ZEROCOPY : 0);
+    struct w_iov_sq q = w_iov_sq_initializer(q);
+    if (zc) {
+        zc_reap(s);
+        sq_concat(&q, o);
+    }
+    struct w_iov * v = vec ? vec->v[0] : sq_first(zc ? &q : o);
+#else
+    const int flags = MSG_DONTWAIT;
+    struct w_iov * v = vec ? vec->v[0] : sq_first(o);
+#endif
+#ifdef WITH_URING
+    s->__tx_ready = false;
+#endif
+    // destinations are converted into sockaddrs only when they change (and
+    // virtual w_socks are never connected in the kernel)
+    struct w_mmsg * const mm = w_connected(s) && s->__mux == 0 ? 0 : mmsg(s);
+    struct sockaddr_storage * dst = mm ? &mm->tx_sa : 0;
+    uint_t n = 0;
+    while (v) {
+        if (mm && dst != &mm->tx_sa) {
+            // sa[] is reused below, so remember the last destination
+            mm->tx_sa = *dst;
+            dst = &mm->tx_sa;
+        }
+#ifdef HAVE_UDP_GSO
+        // the kernel refuses GSO on sockets that don't send UDP checksums
+        const bool gso = s->w->b->gso && s->opt.disable_udp_gso == false &&
+                         s->opt.enable_udp_zero_checksums == false;
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+        const size_t max_segs = zc ? GSO_MAX_SEGS_ZC : GSO_MAX_SEGS;
+#else
+        const size_t max_segs = GSO_MAX_SEGS;
+#endif
+#endif
+        size_t i = 0; // index into msg[]
+        size_t m;     // index into msgvec[]
+        for (m = 0; m < SEND_SIZE && i < SEND_SIZE && v; m++) {
+#ifdef HAVE_SENDMMSG
+            struct msghdr * const mh = &msgvec[m].msg_hdr;
+#else
+            struct msghdr * const mh = &msgvec[m];
+#endif
+            first[m] = v;
+            first_k[m] = k;
 
             // for sendmmsg, we populate the parameters
             msg[i] = (struct iovec){.iov_base = v->buf, .iov_len = v->len};
             // if w_sock is disconnected, use destination IP and port from w_iov
             // instead of the one in the template header
             if (w_connected(s))
-                v->saddr = s->tup.remote;
-            else
-                to_sockaddr((struct sockaddr *)&sa[i], &v->wv_addr, v->wv_port,
+                *v->saddr = s->tup.remote;
+            else if (w_sockaddr_cmp(v->saddr, &mm->tx_dst) == false) {
+                to_sockaddr((struct sockaddr *)&sa[m], &v->wv_addr, v->wv_port,
                             s->ws_scope);
-#ifdef HAVE_SENDMMSG
-            msgvec[i].msg_hdr =
-#else
-            msgvec[i] =
+                dst = &sa[m];
+                mm->tx_dst = *v->saddr;
+            }
+            *mh = (struct msghdr){
+                .msg_name = dst,
+                .msg_namelen = dst ? sa_len(dst->ss_family) : 0,
+                .msg_iov = &msg[i++],
+                .msg_iovlen = 1};
+
+            const uint8_t tos = v->flags;
+            if (tos == 0 && s->opt.enable_ecn)
+                // make sure that the flags reflect what went out on the wire
+                v->flags = ECN_ECT0;
+
+#ifdef HAVE_UDP_GSO
+            const struct w_iov * const lead = v;
+            uint32_t tot_len = v->len;
+#endif
+            v = tx_next(vec, v, &k);
+
+#ifdef HAVE_UDP_GSO
+            // append following w_iovs that can go into the same super-datagram
+            while (gso && v && i < SEND_SIZE && mh->msg_iovlen < max_segs &&
+                   v->len && v->len <= lead->len &&
+                   tot_len + v->len <= GSO_MAX_LEN) {
+                if (w_connected(s) == false &&
+                    (v->wv_port != lead->wv_port ||
+                     w_addr_cmp(&v->wv_addr, &lead->wv_addr) == false))
+                    break;
+                const uint8_t f =
+                    v->flags == 0 && s->opt.enable_ecn ? ECN_ECT0 : v->flags;
+                if (f != lead->flags)
+                    break;
+
+                v->flags = f;
+                if (w_connected(s))
+                    *v->saddr = s->tup.remote;
+                msg[i++] = (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+                mh->msg_iovlen++;
+                tot_len += v->len;
+
+                // a shorter segment must be the last one
+                const bool last = v->len < lead->len;
+                v = tx_next(vec, v, &k);
+                if (last)
+                    break;
+            }
 #endif
-                (struct msghdr){
-                    .msg_name = w_connected(s) ? 0 : &sa[i],
-                    .msg_namelen = w_connected(s) ? 0 : sa_len(sa[i].ss_family),
-                    .msg_iov = &msg[i],
-                    .msg_iovlen = 1};
 
+            uint8_t * c = ctrl[m];
             // set TOS from w_iov
-            if (v->flags) {
-#ifdef HAVE_SENDMMSG
-                msgvec[i].msg_hdr.msg_control = &ctrl[i];
-                msgvec[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
-                struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msgvec[i].msg_hdr);
-#else
-                msgvec[i].msg_control = &ctrl[i];
-                msgvec[i].msg_controllen = sizeof(ctrl[i]);
-                struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msgvec[i]);
-#endif
+            if (tos) {
+                struct cmsghdr * const cmsg = (void *)c;
                 cmsg->cmsg_level =
-                    v->wv_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
-                cmsg->cmsg_type = v->wv_af == AF_INET ? IP_TOS : IPV6_TCLASS;
-                cmsg->cmsg_len =
+                    first[m]->wv_af == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+                cmsg->cmsg_type =
+                    first[m]->wv_af == AF_INET ? IP_TOS : IPV6_TCLASS;
 #ifdef __FreeBSD__
-                    CMSG_LEN(v->wv_af == AF_INET ? sizeof(char) : sizeof(int));
+                const size_t tos_len =
+                    first[m]->wv_af == AF_INET ? sizeof(char) : sizeof(int);
 #else
-                    CMSG_LEN(sizeof(int));
+                const size_t tos_len = sizeof(int);
+#endif
+                cmsg->cmsg_len = CMSG_LEN(tos_len);
+                *(int *)(void *)CMSG_DATA(cmsg) = tos;
+                c += CMSG_SPACE(tos_len);
+            }
+
+#ifdef HAVE_UDP_GSO
+            // set GSO segment size
+            if (mh->msg_iovlen > 1) {
+                struct cmsghdr * const cmsg = (void *)c;
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *)(void *)CMSG_DATA(cmsg) = lead->len;
+                c += CMSG_SPACE(sizeof(uint16_t));
+            }
 #endif
-                *(int *)(void *)CMSG_DATA(cmsg) = v->flags;
-            } else if (s->opt.enable_ecn)
-                // make sure that the flags reflect what went out on the wire
-                v->flags = ECN_ECT0;
 
-            v = sq_next(v, next);
+            if (c != ctrl[m]) {
+                mh->msg_control = ctrl[m];
+                mh->msg_controllen = (socklen_t)(c - ctrl[m]);
+            }
         }
 
         const ssize_t r =
-#if defined(HAVE_SENDMMSG)
-            sendmmsg((int)s->fd, msgvec, (unsigned int)i, 0);
+#if defined(WITH_URING)
+            uring_sendmmsg(s, msgvec, (unsigned int)m);
+#elif defined(HAVE_SENDMMSG)
+            sendmmsg((int)s->fd, msgvec, (unsigned int)m, flags);
 #else
-            sendmsg((int)s->fd, msgvec, 0);
+            sendmsg((int)s->fd, msgvec, flags);
+#endif
+
+#ifdef HAVE_UDP_GSO
+        if (unlikely(r < 0 && (errno == EIO || errno == EINVAL) &&
+                     msgvec[0].msg_hdr.msg_iovlen > 1)) {
+            // the kernel or NIC can't do GSO after all, resend without
+            warn(WRN, "UDP GSO failed (%s), disabling", strerror(errno));
+            s->w->b->gso = false;
+            v = first[0];
+            k = first_k[0];
+            continue;
+        }
 #endif
-        if (unlikely(r < 0 && errno != EAGAIN && errno != ETIMEDOUT))
+
+        const bool blocked = r < 0 && errno == EAGAIN;
+        if (unlikely(r < 0 && blocked == false))
             warn(ERR, "sendmsg/sendmmsg returned %d (%s)", errno,
                  strerror(errno));
-    } while (v);
+#ifdef HAVE_SENDMMSG
+        else if (unlikely(r >= 0 && (size_t)r < m)) {
+            // retry the messages that didn't go out
+            v = first[r];
+            k = first_k[r];
+        }
+#endif
+
+        // messages that failed for other reasons than a full buffer are gone
+        const size_t done = r >= 0 ? (size_t)r : blocked ? 0 : m;
+        for (size_t j = 0; j < done; j++)
+#ifdef HAVE_SENDMMSG
+            n += msgvec[j].msg_hdr.msg_iovlen;
+#else
+            n += msgvec[j].msg_iovlen;
+#endif
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+        if (zc)
+            zc_sent(s, &q, msgvec, r < 0 ? 0 : (size_t)r, r < 0 ? done : 0);
+#endif
+
+        if (unlikely(blocked)) {
+            tx_block(s);
+            break;
+        }
+    }
+
+    if (mm && dst != &mm->tx_sa)
+        mm->tx_sa = *dst;
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+    if (zc)
+        // return what wasn't handed off
+        sq_concat(o, &q);
+#endif
+    return cnt - n;
 }
 
 
-/// Calls recvmsg() or recvmmsg() for all sockets associated with the engine,
-/// emulating the operation of netmap backend_rx() function. Appends all data to
-/// the w_sock::iv socket buffers of the respective w_sock structures.
+/// Loops over the w_iov structures in the tail queue @p o, sending them all
+/// over w_sock @p s. This backend uses the Socket API.
 ///
-/// @param      s     w_sock for which the application would like to receive new
-///                   data.
-/// @param      i     w_iov tail queue to append new data to.
+/// If the kernel supports UDP GSO, runs of w_iovs with the same length,
+/// destination and TOS byte are handed to the kernel as a single
+/// super-datagram, which it segments into individual UDP packets (in the NIC,
+/// if it can do UDP segmentation offload.) The last w_iov of a run may be
+/// shorter than the others.
 ///
-void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
+/// Sends never block. If the send buffer of @p s fills up, w_tx() stops and
+/// sets w_sock::tx_blocked; w_nic_rx() and w_rx_ready() report @p s once it
+/// becomes writable again, and the w_iovs that were not handed off can then be
+/// passed to w_tx() again. w_iovs the kernel rejects with other errors are
+/// counted as handed off, since they are lost like packets the network drops.
+///
+/// If MSG_ZEROCOPY is enabled on @p s, the w_iovs that were handed off are
+/// removed from @p o, and returned by w_tx_done() once the kernel is done with
+/// them. Either way, the w_iovs that were not handed off are the last ones in
+/// @p o, which is what the return value counts.
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      o     w_iov_sq to send.
+///
+/// @return     Number of w_iovs that were not handed off. They are the last
+///             ones in @p o, and can be passed to w_tx() again.
+///
+uint_t w_tx(struct w_sock * const s, struct w_iov_sq * const o)
 {
-#ifdef HAVE_RECVMMSG
-// There is a tradeoff here in terms of how many messages we should try and
-// receive. Preparing to handle longer sizes has preparation overheads, whereas
-// only handling shorter sizes may require multiple syscalls (and incur their
-// overheads). So we're picking a number out of a hat.
-#define RECV_SIZE MIN(64, IOV_MAX)
-#else
-#define RECV_SIZE 1
+    return tx(s, o, 0);
+}
+
+
+/// Send the w_iovs in @p vec over w_sock @p s, like w_tx() does for a w_iov_sq.
+/// Afterwards, @p vec holds what w_tx() would leave in its tail queue, i.e.,
+/// with MSG_ZEROCOPY, only the w_iovs that were not handed off.
+///
+/// The send messages are filled from @p vec directly, without linking its
+/// w_iovs. Only with MSG_ZEROCOPY, which tracks pending w_iovs in tail queues,
+/// are they linked and passed to w_tx().
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      vec   w_iov_vec to send.
+///
+/// @return     Number of w_iovs that were not handed off. They are the last
+///             ones in @p vec, and can be passed to w_tx_vec() again.
+///
+uint32_t w_tx_vec(struct w_sock * const s, struct w_iov_vec * const vec)
+{
+    if (unlikely(vec->cnt == 0))
+        return 0;
+
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+    if (s->opt.enable_zerocopy) {
+        struct w_iov_sq o;
+        vec_to_sq(vec, &o);
+        const uint_t n = w_tx(s, &o);
+        vec->cnt = vec->len = 0;
+        sq_to_vec(&o, vec);
+        return (uint32_t)n;
+    }
 #endif
-    ssize_t n = 0;
-    do {
-        struct w_iov * v[RECV_SIZE];
-        struct iovec msg[RECV_SIZE];
-        struct sockaddr_storage sa[RECV_SIZE];
-        __extension__ uint8_t ctrl[RECV_SIZE][CMSG_SPACE(sizeof(uint8_t)) +
-                                              CMSG_SPACE(sizeof(uint8_t))];
-#ifdef HAVE_RECVMMSG
-        struct mmsghdr msgvec[RECV_SIZE];
+    return (uint32_t)tx(s, 0, vec);
+}
+
+
+/// Return the w_iovs of MSG_ZEROCOPY transmissions on w_sock @p s that the
+/// kernel is done with, by appending them to tail queue @p q in the order they
+/// were passed to w_tx(). They must eventually be returned to warpcore via
+/// w_free().
+///
+/// @param      s     w_sock socket that was transmitted over.
+/// @param      q     w_iov tail queue to append completed w_iovs to.
+///
+void w_tx_done(struct w_sock * const s
+#if !defined(HAVE_MSG_ZEROCOPY) || defined(WITH_URING)
+               __attribute__((unused))
+#endif
+               ,
+               struct w_iov_sq * const q
+#if !defined(HAVE_MSG_ZEROCOPY) || defined(WITH_URING)
+               __attribute__((unused))
+#endif
+)
+{
+#if defined(HAVE_MSG_ZEROCOPY) && !defined(WITH_URING)
+    if (s->__zc) {
+        zc_reap(s);
+        sq_concat(q, &s->__zc->done);
+    }
+#endif
+}
+
+
+/// Extract the TOS byte and TTL from the control data of the received message
+/// @p mh into w_iov @p v.
+///
+/// @param      mh    A message filled in by recvmsg() or recvmmsg().
+/// @param      v     The w_iov to update.
+///
+/// @return     The UDP GRO segment size if @p mh holds a UDP GRO
+///             super-datagram, zero otherwise.
+///
+uint16_t rx_cmsg(struct msghdr * const mh, struct w_iov * const v)
+{
+    uint16_t gso_size = 0;
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(mh); cmsg;
+         cmsg = CMSG_NXTHDR(mh, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP ||
+            cmsg->cmsg_level == IPPROTO_IPV6) {
+            if (cmsg->cmsg_type ==
+#ifdef __linux__
+                    IP_TOS
 #else
-        struct msghdr msgvec[RECV_SIZE];
+                    IP_RECVTOS
 #endif
-        ssize_t nbufs = 0;
-        for (int j = 0; likely(j < RECV_SIZE); j++, nbufs++) {
-            v[j] = w_alloc_iov(s->w, s->ws_af, 0, 0);
-            if (unlikely(v[j] == 0))
-                break;
-            msg[j] =
-                (struct iovec){.iov_base = v[j]->buf, .iov_len = v[j]->len};
-#ifdef HAVE_RECVMMSG
-            msgvec[j].msg_hdr =
+                || cmsg->cmsg_type == IPV6_TCLASS)
+                v->flags = *(uint8_t *)CMSG_DATA(cmsg);
+#ifndef PARTICLE
+            else if (cmsg->cmsg_type ==
+#ifdef __linux__
+                     IP_TTL
 #else
-            msgvec[j] =
+                     IP_RECVTTL
+#endif
+            )
+                v->ttl = *(uint8_t *)CMSG_DATA(cmsg);
+#endif
+        }
+#ifdef HAVE_UDP_GRO
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            gso_size = (uint16_t) * (int *)(void *)CMSG_DATA(cmsg);
 #endif
+    }
+    return gso_size;
+}
+
+
+#ifndef WITH_URING
+#ifdef HAVE_UDP_GRO
+/// Receive UDP GRO super-datagrams on w_sock @p s into engine-wide scratch
+/// space and split them into individual w_iovs, one per original packet.
+///
+/// @param      s     w_sock for which the application would like to receive new
+///                   data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+static void __attribute__((nonnull))
+w_rx_gro(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    uint8_t * const gro_buf = s->w->b->gro_buf;
+    int n;
+    do {
+        struct iovec msg[GRO_SIZE];
+        struct sockaddr_storage sa[GRO_SIZE];
+        __extension__ uint8_t ctrl[GRO_SIZE][CMSG_SPACE(sizeof(uint8_t)) +
+                                             CMSG_SPACE(sizeof(uint8_t)) +
+                                             CMSG_SPACE(sizeof(int))];
+        struct mmsghdr msgvec[GRO_SIZE];
+        for (int j = 0; likely(j < GRO_SIZE); j++) {
+            msg[j] = (struct iovec){.iov_base = gro_buf + j * GRO_BUF_LEN,
+                                    .iov_len = GRO_BUF_LEN};
+            msgvec[j].msg_hdr =
                 (struct msghdr){.msg_name = &sa[j],
                                 .msg_namelen = sizeof(sa[j]),
                                 .msg_iov = &msg[j],
@@ -455,81 +1842,311 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
                                 .msg_control = &ctrl[j],
                                 .msg_controllen = sizeof(ctrl[j])};
         }
+
+        n = recvmmsg((int)s->fd, msgvec, GRO_SIZE, MSG_DONTWAIT, 0);
+        if (unlikely(n < 0)) {
+            if (errno != EAGAIN && errno != ETIMEDOUT)
+                warn(ERR, "recvmmsg returned %d (%s)", errno, strerror(errno));
+            return;
+        }
+
+        for (int j = 0; likely(j < n); j++) {
+            struct w_sockaddr tmpl_sa;
+            struct w_iov tmpl = {.saddr = &tmpl_sa};
+            tmpl.wv_port = sa_port(&sa[j]);
+            w_to_waddr(&tmpl.wv_addr, (struct sockaddr *)&sa[j]);
+            const uint16_t gso_size = rx_cmsg(&msgvec[j].msg_hdr, &tmpl);
+            const uint8_t * const data = msg[j].iov_base;
+            const uint32_t len = msgvec[j].msg_len;
+
+            for (uint32_t off = 0; off < len; off += gso_size ? gso_size : len) {
+                struct w_iov * const v = w_alloc_iov(s->w, s->ws_af, 0, 0);
+                if (unlikely(v == 0)) {
+                    warn(CRT, "no more bufs");
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+                    rx_rearm(s);
+#endif
+                    return;
+                }
+                // truncate like recvmsg() would for oversized packets
+                v->len = (uint16_t)MIN(MIN(gso_size ? gso_size : len, len - off),
+                                       v->len);
+                memcpy(v->buf, data + off, v->len);
+                *v->saddr = tmpl_sa;
+                v->flags = tmpl.flags;
+                v->ttl = tmpl.ttl;
+                sq_insert_tail(i, v, next);
+            }
+        }
+    } while (n == GRO_SIZE);
+}
+#endif
+
+
+/// Grow the receive slots of @p mm to @p cap entries, and point the messages at
+/// their slots.
+///
+/// @param      mm    The w_mmsg of a w_sock.
+/// @param[in]  cap   New number of slots.
+///
+static void __attribute__((nonnull))
+grow_slots(struct w_mmsg * const mm, const uint32_t cap)
+{
+    struct w_rx_slot * const slot = realloc(mm->slot, cap * sizeof(*slot));
+    ensure(slot, "cannot alloc w_rx_slot");
+    mm->slot = slot;
+    void * const msgvec = realloc(mm->msgvec, cap * sizeof(*mm->msgvec));
+    ensure(msgvec, "cannot alloc msgvec");
+    mm->msgvec = msgvec;
+
+    for (uint32_t j = 0; j < cap; j++)
+        *rx_mh(mm, j) = (struct msghdr){.msg_name = &slot[j].sa,
+                                        .msg_namelen = sizeof(slot[j].sa),
+                                        .msg_iov = &slot[j].msg,
+                                        .msg_iovlen = 1,
+                                        .msg_control = &slot[j].ctrl,
+                                        .msg_controllen = sizeof(slot[j].ctrl)};
+    mm->cap = cap;
+}
+
+
+/// Receive everything pending on the kernel socket of w_sock @p s with
+/// recvmsg() or recvmmsg(), appending it to @p i, or if @p vec is non-zero,
+/// as much as fits to @p vec.
+///
+/// The w_sock keeps its receive messages bound to w_iovs between calls, and
+/// adapts the number of messages it receives per call to how many arrive. It
+/// returns the w_iovs once a call receives nothing, and the engine limits how
+/// many its w_socks keep in total, so many w_socks cannot drain the pool.
+///
+/// @param      s     w_sock to receive on.
+/// @param      i     w_iov tail queue to append new data to, unless @p vec is
+///                   non-zero.
+/// @param      vec   w_iov_vec with room to append new data to, or zero.
+///
+static void __attribute__((nonnull(1)))
+rx_mm(struct w_sock * const s,
+      struct w_iov_sq * const i,
+      struct w_iov_vec * const vec)
+{
+    struct w_mmsg * const mm = mmsg(s);
+    struct w_backend * const b = s->w->b;
+    uint32_t got = 0;
+    uint32_t nbufs;
+    ssize_t n;
+    b->rx_pinned -= mm->armed;
+    do {
+        if (unlikely(mm->cap < mm->batch))
+            grow_slots(mm, mm->batch);
+
+        // bind w_iovs to the slots that gave theirs away
+        while (mm->armed < mm->batch) {
+            struct w_iov * const v = w_alloc_iov(s->w, s->ws_af, 0, 0);
+            if (unlikely(v == 0))
+                break;
+            struct w_rx_slot * const slot = &mm->slot[mm->armed++];
+            slot->v = v;
+            slot->msg = (struct iovec){.iov_base = v->buf, .iov_len = v->len};
+        }
+        nbufs = vec ? MIN(mm->armed, W_IOV_VEC_MAX - vec->cnt) : mm->armed;
         if (unlikely(nbufs == 0)) {
             warn(CRT, "no more bufs");
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+            rx_rearm(s);
+#endif
             return;
         }
+
 #if defined(HAVE_RECVMMSG)
-        n = (ssize_t)recvmmsg((int)s->fd, msgvec, (unsigned int)nbufs,
-                              MSG_DONTWAIT, 0);
+        n = (ssize_t)recvmmsg((int)s->fd, mm->msgvec, nbufs, MSG_DONTWAIT, 0);
 #else
-        n = recvmsg((int)s->fd, msgvec, MSG_DONTWAIT);
-#endif
+        n = recvmsg((int)s->fd, mm->msgvec, MSG_DONTWAIT);
         if (likely(n > 0)) {
-            for (int j = 0; likely(j < MIN(n, nbufs)); j++) {
-                v[j]->wv_port = sa_port(&sa[j]);
-                w_to_waddr(&v[j]->wv_addr, (struct sockaddr *)&sa[j]);
+            mm->slot[0].v->len = (uint16_t)n;
+            // recvmsg returns number of bytes, we need number of messages
+            n = 1;
+        }
+#endif
+        if (unlikely(n < 0)) {
+            if (errno != EAGAIN && errno != ETIMEDOUT)
+                warn(ERR, "recvmsg/recvmmsg returned %d (%s)", errno,
+                     strerror(errno));
+            n = 0;
+        }
 
+        for (uint32_t j = 0; likely(j < (uint32_t)n); j++) {
+            struct w_rx_slot * const slot = &mm->slot[j];
+            struct msghdr * const mh = rx_mh(mm, j);
+            struct w_iov * const v = slot->v;
+            v->wv_port = sa_port(&slot->sa);
+            w_to_waddr(&v->wv_addr, (struct sockaddr *)&slot->sa);
 #ifdef HAVE_RECVMMSG
-                v[j]->len = (uint16_t)msgvec[j].msg_len;
-#else
-                v[j]->len = (uint16_t)n;
-                // recvmsg returns number of bytes, we need number of
-                // messages for the return loop below
-                n = 1;
+            v->len = (uint16_t)mm->msgvec[j].msg_len;
 #endif
+            // extract TOS byte (Particle uses recvfrom w/o cmsg support)
+            rx_cmsg(mh, v);
+
+            // add the iov to the tail of the result
+            if (vec) {
+                vec->v[vec->cnt++] = v;
+                vec->len += v->len;
+            } else
+                sq_insert_tail(i, v, next);
+
+            // undo what the kernel changed
+            mh->msg_namelen = sizeof(slot->sa);
+            mh->msg_controllen = sizeof(slot->ctrl);
+        }
 
-                // extract TOS byte (Particle uses recvfrom w/o cmsg support)
-#ifdef HAVE_RECVMMSG
-                for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msgvec[j].msg_hdr);
-                     cmsg; cmsg = CMSG_NXTHDR(&msgvec[j].msg_hdr, cmsg)) {
-#else
-                for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msgvec[j]); cmsg;
-                     cmsg = CMSG_NXTHDR(&msgvec[j], cmsg)) {
+        // move the slots that still have a w_iov to the front
+        for (uint32_t j = (uint32_t)n; j < mm->armed; j++) {
+            mm->slot[j - (uint32_t)n].v = mm->slot[j].v;
+            mm->slot[j - (uint32_t)n].msg = mm->slot[j].msg;
+        }
+        mm->armed -= (uint32_t)n;
+        got += (uint32_t)n;
+
+        if ((uint32_t)n == mm->batch && mm->batch < RECV_MAX)
+            mm->batch *= 2;
+
+        if (vec && vec->cnt == W_IOV_VEC_MAX) {
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+            // there may be more, which an edge-triggered engine won't report
+            if ((uint32_t)n == nbufs)
+                rx_rearm(s);
 #endif
-                    if (cmsg->cmsg_level == IPPROTO_IP ||
-                        cmsg->cmsg_level == IPPROTO_IPV6) {
-                        if (cmsg->cmsg_type ==
-#ifdef __linux__
-                                IP_TOS
-#else
-                                IP_RECVTOS
+            break;
+        }
+    } while ((uint32_t)n == nbufs);
+
+    if (got < mm->batch / 4 && mm->batch > RECV_MIN) {
+        // not much arrived, so bind fewer w_iovs
+        mm->batch /= 2;
+        while (mm->armed > mm->batch)
+            w_free_iov(mm->slot[--mm->armed].v);
+    }
+
+    // an idle w_sock returns its w_iovs, and all w_socks of the engine together
+    // keep at most a quarter of its buffers bound between calls
+    const uint32_t cap = b->nbufs / 4;
+    uint32_t keep = got ? mm->armed : 0;
+    if (b->rx_pinned + keep > cap)
+        keep = cap > b->rx_pinned ? cap - b->rx_pinned : 0;
+    while (mm->armed > keep)
+        w_free_iov(mm->slot[--mm->armed].v);
+    b->rx_pinned += mm->armed;
+}
+
+
+/// Receive everything pending on the kernel socket of w_mux w_sock @p m, and
+/// queue each packet on the virtual w_sock its four-tuple (or local address and
+/// port) belongs to. Packets no w_sock claims are dropped.
+///
+/// @param      m     Internal w_sock of a w_mux.
+///
+static void __attribute__((nonnull)) mux_rx(struct w_sock * const m)
+{
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    rx_mm(m, &i, 0);
+
+    const struct flowtab * const ft = &m->w->b->vsock;
+    while (!sq_empty(&i)) {
+        struct w_iov * const v = sq_first(&i);
+        sq_remove_head(&i, next);
+        struct w_sock * const s = flowtab_demux(ft, &m->ws_loc, v->saddr);
+        if (unlikely(s == 0)) {
+            w_free_iov(v);
+            continue;
+        }
+        sq_insert_tail(&s->iv, v, next);
+        mark_ready(s);
+    }
+}
+
+
+/// Calls recvmsg() or recvmmsg() for all sockets associated with the engine,
+/// emulating the operation of netmap backend_rx() function. Appends all data to
+/// the w_sock::iv socket buffers of the respective w_sock structures.
+///
+/// Each w_sock keeps its receive messages bound to w_iovs between calls, and
+/// adapts the number of messages it receives per call to how many arrive.
+///
+/// If UDP GRO is enabled on @p s, coalesced super-datagrams are split back into
+/// one w_iov per packet. Pending MSG_ZEROCOPY completions are also processed.
+///
+/// For a virtual w_sock, receives on the kernel socket it shares, and queues
+/// what belongs to the other w_socks sharing it on those.
+///
+/// @param      s     w_sock for which the application would like to receive new
+///                   data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    if (s->__mux)
+        // this also queues data for the other w_socks sharing the socket
+        mux_rx(&s->__mux->s);
+
+    // return what an earlier w_rx_vec() had no room for first
+    sq_concat(i, &s->iv);
+    if (s->__mux)
+        return;
+
+#ifdef HAVE_MSG_ZEROCOPY
+    // zero-copy completions make the socket readable, so process them here
+    zc_reap(s);
 #endif
-                            || cmsg->cmsg_type == IPV6_TCLASS)
-                            v[j]->flags = *(uint8_t *)CMSG_DATA(cmsg);
-#ifndef PARTICLE
-                        else if (cmsg->cmsg_type ==
-#ifdef __linux__
-                                 IP_TTL
-#else
-                                 IP_RECVTTL
+#ifdef HAVE_UDP_GRO
+    if (s->opt.enable_udp_gro) {
+        w_rx_gro(s, i);
+        return;
+    }
 #endif
-                        )
-                            v[j]->ttl = *(uint8_t *)CMSG_DATA(cmsg);
+    rx_mm(s, i, 0);
+}
+
+
+/// Append data that has been received on w_sock @p s to @p vec, as far as it
+/// fits. The w_iovs must eventually be returned to warpcore via w_free_vec().
+///
+/// The w_iovs that the receive messages are bound to go into @p vec directly,
+/// and data that does not fit stays in the kernel socket. Only virtual w_socks
+/// and UDP GRO, which receive into other w_socks or scratch space, receive via
+/// w_rx() and queue what does not fit on @p s. Either way, it is returned first
+/// by the next w_rx_vec() or w_rx() call, and callers should therefore call
+/// w_rx_vec() again for as long as it fills @p vec up.
+///
+/// @param      s     w_sock for which the application would like to receive new
+///                   data.
+/// @param      vec   w_iov_vec to append new data to.
+///
+/// @return     Number of w_iovs appended.
+///
+uint32_t w_rx_vec(struct w_sock * const s, struct w_iov_vec * const vec)
+{
+    const uint32_t cnt = vec->cnt;
+    sq_to_vec(&s->iv, vec);
+    if (s->__mux
+#ifdef HAVE_UDP_GRO
+        || s->opt.enable_udp_gro
 #endif
-                    }
-                }
-                // add the iov to the tail of the result
-                sq_insert_tail(i, v[j], next);
-            }
-        } else {
-            if (unlikely(n < 0 && errno != EAGAIN && errno != ETIMEDOUT))
-                warn(ERR, "recvmsg/recvmmsg returned %d (%s)", errno,
-                     strerror(errno));
-            n = 0;
-        }
+    ) {
+        struct w_iov_sq i = w_iov_sq_initializer(i);
+        w_rx(s, &i);
+        sq_to_vec(&i, vec);
+        sq_concat(&s->iv, &i);
+        return vec->cnt - cnt;
+    }
 
-        // return any unused buffers
-        for (ssize_t j = n; likely(j < nbufs); j++)
-            w_free_iov(v[j]);
-    } while (
-#ifdef HAVE_RECVMMSG
-        n == RECV_SIZE
-#else
-        n == 1
+#ifdef HAVE_MSG_ZEROCOPY
+    // zero-copy completions make the socket readable, so process them here
+    zc_reap(s);
 #endif
-    );
+    if (likely(vec->cnt < W_IOV_VEC_MAX))
+        rx_mm(s, 0, vec);
+    return vec->cnt - cnt;
 }
+#endif
 
 
 /// The sock backend performs no operation here.
@@ -539,87 +2156,276 @@ void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
 void w_nic_tx(struct w_engine * const w __attribute__((unused))) {}
 
 
-/// Check/wait until any data has been received.
+/// The sock backend does not limit how much w_nic_rx() processes per call, so
+/// it never leaves anything pending.
+///
+/// @param[in]  w     Backend engine.
+///
+/// @return     False.
+///
+bool w_nic_rx_pending(const struct w_engine * const w __attribute__((unused)))
+{
+    return false;
+}
+
+
+#ifndef WITH_URING
+
+
+/// Clear w_sock::tx_blocked on the virtual w_socks sharing the kernel socket of
+/// w_mux w_sock @p m, which has become writable, and have w_rx_ready() report
+/// them. (This visits all virtual w_socks, but only when a send buffer had
+/// filled up.)
+///
+/// @param      m     Internal w_sock of a w_mux.
+///
+static void __attribute__((nonnull)) mux_unblock(struct w_sock * const m)
+{
+    struct w_sock * s;
+    flowtab_foreach(&m->w->b->vsock, s, {
+        if (s->tx_blocked && &s->__mux->s == m) {
+            s->tx_blocked = false;
+            s->__tx_ready = true;
+            mark_ready(s);
+        }
+    });
+}
+
+
+#if defined(HAVE_KQUEUE) || defined(HAVE_EPOLL)
+/// Clear w_sock::tx_blocked on the sockets for which the last kevent() or
+/// epoll_wait() call reported writability. (kqueue already removed the oneshot
+/// EVFILT_WRITE filter, and for epoll, EPOLLOUT is disarmed here.)
+///
+/// @param      b     Backend.
+///
+/// @return     Whether the call also reported any w_sock as readable.
+///
+static bool __attribute__((nonnull)) tx_unblock(struct w_backend * const b)
+{
+    bool rcvd = false;
+    for (int i = 0; i < b->n; i++) {
+#if defined(HAVE_KQUEUE)
+        rcvd |= b->ev[i].filter == EVFILT_READ;
+        if (b->ev[i].filter == EVFILT_WRITE) {
+            struct w_sock * const s = b->ev[i].udata;
+            s->tx_blocked = false;
+#else
+        rcvd |= (b->ev[i].events & EPOLLIN) != 0;
+        if (b->ev[i].events & EPOLLOUT) {
+            struct w_sock * const s = b->ev[i].data.ptr;
+            s->tx_blocked = false;
+            ep_arm(s, EPOLL_CTL_MOD);
+#endif
+            if (s->w->opt.enable_virtual_socks)
+                mux_unblock(s);
+        }
+    }
+    return rcvd;
+}
+#endif
+
+
+/// Check/wait until any data has been received, or until a w_sock that was
+/// blocked on transmit has become writable. The timeout has nanosecond
+/// precision, except with epoll on kernels without epoll_pwait2(), or with
+/// poll() on platforms without ppoll(), where it is rounded up to milliseconds.
 ///
 /// @param[in]  w     Backend engine.
 /// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
 ///                   for infinite wait.
+/// @param[out] rcvd  If non-zero, set to whether any data is ready for reading
+///                   (rather than only a w_sock having become writable.)
 ///
-/// @return     Whether any data is ready for reading.
+/// @return     Whether any data is ready for reading, or any w_sock has become
+///             writable.
 ///
-bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+bool backend_nic_rx(struct w_engine * const w,
+                    const int64_t nsec,
+                    bool * const rcvd)
 {
     struct w_backend * const b = w->b;
+    backend_shrink(w);
 
 #if defined(HAVE_KQUEUE)
-    b->n = kevent(b->kq, 0, 0, b->ev, sizeof(b->ev) / sizeof(b->ev[0]),
-                  nsec == -1
-                      ? 0
-                      : &(struct timespec){(uint64_t)nsec / NS_PER_S,
-                                           (long)((uint64_t)nsec % NS_PER_S)});
+    struct timespec ts;
+    b->n = kevent(b->kq, 0, 0, b->ev, (int)b->ev_len, timeout_ts(nsec, &ts));
+    const bool r = tx_unblock(b);
+    if (rcvd)
+        *rcvd = r;
     return b->n > 0;
 
 #elif defined(HAVE_EPOLL)
-    b->n = epoll_wait(b->ep, b->ev, sizeof(b->ev) / sizeof(b->ev[0]),
-                      nsec == -1 ? -1 : (int)(nsec / NS_PER_MS));
+#ifdef HAVE_EPOLL_PWAIT2
+    // the kernel may predate epoll_pwait2(), in which case we stop trying
+    // (engines on other threads may find out at the same time)
+    static bool no_pwait2 = false;
+    bool fallback = __atomic_load_n(&no_pwait2, __ATOMIC_RELAXED);
+    if (likely(fallback == false)) {
+        struct timespec ts;
+        b->n = epoll_pwait2(b->ep, b->ev, (int)b->ev_len,
+                            timeout_ts(nsec, &ts), 0);
+        if (unlikely(b->n == -1 && errno == ENOSYS)) {
+            __atomic_store_n(&no_pwait2, true, __ATOMIC_RELAXED);
+            fallback = true;
+        }
+    }
+    if (unlikely(fallback))
+#endif
+        b->n = epoll_wait(b->ep, b->ev, (int)b->ev_len, timeout_ms(nsec));
+#ifdef HAVE_SO_INCOMING_NAPI_ID
+    if (unlikely(w->opt.busy_poll_us))
+        napi_track(b);
+#endif
+    const bool r = tx_unblock(b);
+    if (rcvd)
+        *rcvd = r;
     return b->n > 0;
 
 #else
-
-    int i = 0;
-    struct w_sock * s;
-    sl_foreach (s, &b->socks, __next) {
-        if (i == b->n) {
-            b->n *= 2; // arbitrary value, also used below
-            struct pollfd * const cur_fds = b->fds;
-            b->fds = realloc(b->fds, (size_t)b->n * sizeof(*b->fds));
-            if (unlikely(b->fds == 0)) {
-                warn(CRT, "cannot realloc %d pollfds", b->n);
-                b->fds = cur_fds;
-                b->n /= 2;
-                break;
+    // bind() and close() keep the pollfd set current, and w_tx() asks for
+    // POLLOUT on blocked sockets
+#ifdef HAVE_PPOLL
+    struct timespec ts;
+    b->n = ppoll(b->fds, (nfds_t)b->nfds, timeout_ts(nsec, &ts), 0);
+#else
+    b->n = poll(b->fds, (nfds_t)b->nfds, timeout_ms(nsec));
+#endif
+    bool r = false;
+    if (b->n > 0)
+        for (uint32_t j = 0; j < b->nfds; j++) {
+            r |= (b->fds[j].revents & POLLIN) != 0;
+            if (b->fds[j].revents & POLLOUT) {
+                b->fds_sock[j]->tx_blocked = false;
+                b->fds[j].events = POLLIN;
+                if (w->opt.enable_virtual_socks)
+                    mux_unblock(b->fds_sock[j]);
             }
         }
-        b->fds[i].fd = (int)s->fd;
-        b->fds[i].events = POLLIN;
-        i++;
+    if (rcvd)
+        *rcvd = r;
+    return b->n > 0;
+#endif
+}
+
+
+/// Implements w_rx_ready() for engines with w_engopt::enable_virtual_socks
+/// set. Receives on the shared kernel sockets that have data, which queues it
+/// on their virtual w_socks, and then reports those w_socks.
+///
+/// @param[in]  w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of connections that are ready for reading or writing.
+///
+static uint32_t __attribute__((nonnull))
+mux_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
+{
+    struct w_backend * const b = w->b;
+
+#if defined(HAVE_KQUEUE)
+    if (b->n <= 0) {
+        b->n = kevent(b->kq, 0, 0, b->ev, (int)b->ev_len,
+                      &(struct timespec){0, 0});
+        tx_unblock(b);
     }
+    for (int i = 0; i < b->n; i++)
+        if (b->ev[i].filter == EVFILT_READ)
+            mux_rx(b->ev[i].udata);
+    b->n = 0;
+
+#elif defined(HAVE_EPOLL)
+    if (b->n <= 0) {
+        b->n = epoll_wait(b->ep, b->ev, (int)b->ev_len, 0);
+        tx_unblock(b);
+    }
+    for (int i = 0; i < b->n; i++)
+        if (b->ev[i].events & EPOLLIN)
+            mux_rx(b->ev[i].data.ptr);
+    b->n = 0;
 
-    return poll(b->fds, (nfds_t)i, nsec == -1 ? -1 : (int)NS_TO_MS(nsec)) > 0;
+#else
+    for (uint32_t j = 0; j < b->nfds; j++)
+        if (b->fds[j].revents & POLLIN) {
+            b->fds[j].revents = 0;
+            mux_rx(b->fds_sock[j]);
+        }
 #endif
+
+    // only w_socks on the ready list can qualify, and those that no longer do
+    // are dropped from it
+    struct w_sock * prev = 0;
+    struct w_sock * s = sl_first(&b->ready);
+    uint32_t n = 0;
+    while (s) {
+        struct w_sock * const nxt = sl_next(s, __ready);
+        if (!sq_empty(&s->iv) || s->__tx_ready) {
+            s->__tx_ready = false;
+            sl_insert_head(sl, s, next);
+            n++;
+            prev = s;
+        } else {
+            if (prev)
+                sl_remove_after(prev, __ready);
+            else
+                sl_remove_head(&b->ready, __ready);
+            s->__on_ready = false;
+        }
+        s = nxt;
+    }
+    return n;
 }
 
 
 /// Fill a w_sock_slist with pointers to some sockets with pending inbound
-/// data. Data can be obtained via w_rx() on each w_sock in the list. Call
-/// can optionally block to wait for at least one ready connection. Will
-/// return the number of ready connections, or zero if none are ready. When
-/// the return value is not zero, a repeated call may return additional
-/// ready sockets.
+/// data, or that have become writable after w_tx() was blocked on them. Data
+/// can be obtained via w_rx() on each w_sock in the list. Call can optionally
+/// block to wait for at least one ready connection. Will return the number of
+/// ready connections, or zero if none are ready. When the return value is not
+/// zero, a repeated call may return additional ready sockets.
 ///
 /// @param[in]  w     Backend engine.
 /// @param      sl    Empty and initialized w_sock_slist.
 ///
-/// @return     Number of connections that are ready for reading.
+/// @return     Number of connections that are ready for reading or writing.
 ///
 uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
 {
+    if (w->opt.enable_virtual_socks)
+        return mux_rx_ready(w, sl);
+
     struct w_backend * const b = w->b;
 
 #if defined(HAVE_KQUEUE)
-    if (b->n <= 0)
-        b->n = kevent(b->kq, 0, 0, b->ev, sizeof(b->ev) / sizeof(b->ev[0]),
+    if (b->n <= 0) {
+        b->n = kevent(b->kq, 0, 0, b->ev, (int)b->ev_len,
                       &(struct timespec){0, 0});
+        tx_unblock(b);
+    }
 
-    int i;
-    for (i = 0; i < b->n; i++)
-        sl_insert_head(sl, (struct w_sock *)b->ev[i].udata, next);
+    uint32_t n = 0;
+    for (int i = 0; i < b->n; i++) {
+        struct w_sock * const s = b->ev[i].udata;
+        if (b->ev[i].filter == EVFILT_WRITE) {
+            // skip sockets that are also readable, they have their own event
+            int j;
+            for (j = 0; j < b->n; j++)
+                if (b->ev[j].filter == EVFILT_READ && b->ev[j].udata == s)
+                    break;
+            if (j < b->n)
+                continue;
+        }
+        sl_insert_head(sl, s, next);
+        n++;
+    }
     b->n = 0;
-    return (uint32_t)i;
+    return n;
 
 #elif defined(HAVE_EPOLL)
-    if (b->n <= 0)
-        b->n = epoll_wait(b->ep, b->ev, sizeof(b->ev) / sizeof(b->ev[0]), 0);
+    if (b->n <= 0) {
+        b->n = epoll_wait(b->ep, b->ev, (int)b->ev_len, 0);
+        tx_unblock(b);
+    }
 
     int i;
     for (i = 0; i < b->n; i++)
@@ -629,12 +2435,12 @@ uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
 
 #else
     uint32_t i = 0;
-    struct w_sock * s;
-    sl_foreach (s, &b->socks, __next)
-        if (b->fds[i].revents & POLLIN) {
-            sl_insert_head(sl, s, next);
+    for (uint32_t j = 0; j < b->nfds; j++)
+        if (b->fds[j].revents & (POLLIN | POLLOUT)) {
+            sl_insert_head(sl, b->fds_sock[j], next);
             i++;
         }
     return i;
 #endif
 }
+#endif
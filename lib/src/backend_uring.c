@@ -0,0 +1,645 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include <warpcore/warpcore.h>
+
+#include "backend.h"
+
+
+/// Number of submission queue entries.
+#define SQ_ENTRIES 256
+
+/// Maximum number of w_iov buffers to hand to the kernel for multishot RX.
+#define BR_MAX_ENTRIES 4096
+
+/// Maximum length of a single registered buffer.
+#define FIXED_MAX_LEN (1UL << 30)
+
+// The low bits of io_uring_sqe::user_data encode the operation. For OP_RX and
+// OP_POLL, the upper bits are the w_sock pointer; for OP_TX, they are the
+// message index.
+#define OP_RX 0
+#define OP_TX 1
+#define OP_CANCEL 2
+#define OP_POLL 3
+#define OP_MASK 3
+
+
+/// Submit all queued SQEs to the kernel and optionally wait for completions.
+///
+/// @param      b        Backend.
+/// @param[in]  wait_nr  Number of completions to wait for.
+/// @param[in]  ts       Timeout for the wait, or zero to wait indefinitely.
+///
+static void __attribute__((nonnull(1)))
+enter(struct w_backend * const b,
+      const uint32_t wait_nr,
+      struct __kernel_timespec * const ts)
+{
+    __atomic_store_n(b->sq_tail, b->sq_local, __ATOMIC_RELEASE);
+    const uint32_t to_submit =
+        b->sq_local - __atomic_load_n(b->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_getevents_arg arg = {.ts = (uint64_t)(uintptr_t)ts};
+
+    // always ask for events, so that deferred completion work runs
+    const long r = syscall(
+        __NR_io_uring_enter, b->ring, to_submit, wait_nr,
+        IORING_ENTER_GETEVENTS | (ts ? IORING_ENTER_EXT_ARG : 0),
+        ts ? &arg : 0, ts ? sizeof(arg) : 0);
+    if (unlikely(r < 0 && errno != EINTR && errno != ETIME && errno != EBUSY &&
+                 errno != EAGAIN))
+        warn(ERR, "io_uring_enter returned %d (%s)", errno, strerror(errno));
+}
+
+
+/// Get a zeroed SQE to fill in. The SQE is submitted on the next enter().
+///
+/// @param      b     Backend.
+///
+/// @return     Pointer to a submission queue entry.
+///
+static struct io_uring_sqe * __attribute__((nonnull))
+get_sqe(struct w_backend * const b)
+{
+    if (unlikely(b->sq_local - __atomic_load_n(b->sq_head, __ATOMIC_ACQUIRE) ==
+                 b->sq_entries))
+        enter(b, 0, 0);
+    assure(b->sq_local - *b->sq_head < b->sq_entries, "SQ full");
+
+    struct io_uring_sqe * const sqe = &b->sqe[b->sq_local++ & b->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+
+/// Queue a multishot recvmsg for w_sock @p s, which places packets into buffers
+/// from the provided buffer ring.
+///
+/// @param      s     The w_sock to receive on.
+///
+static void __attribute__((nonnull)) arm_rx(struct w_sock * const s)
+{
+    struct w_backend * const b = s->w->b;
+    struct io_uring_sqe * const sqe = get_sqe(b);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = (int)s->fd;
+    sqe->addr = (uintptr_t)&b->rx_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (uintptr_t)s | OP_RX;
+    s->__rx_armed = true;
+}
+
+
+/// Hand free w_iovs to the kernel, for all buffer IDs in the provided buffer
+/// ring that don't currently have one. Restarts multishot RX on sockets that
+/// ran out of buffers.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) refill(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    const uint16_t nfree = b->br_nfree;
+    while (b->br_nfree) {
+        struct w_iov * const v = w_alloc_iov_base(w);
+        if (unlikely(v == 0))
+            break;
+        const uint16_t bid = b->br_free[--b->br_nfree];
+        b->br_iov[bid] = v;
+
+        // only set addr, len and bid; resv of the first entry is the ring tail
+        struct io_uring_buf * const buf =
+            &b->br->bufs[b->br_tail++ & b->br_mask];
+        buf->addr = (uintptr_t)v->base;
+        buf->len = max_buf_len(w);
+        buf->bid = bid;
+    }
+    if (b->br_nfree != nfree)
+        __atomic_store_n(&b->br->tail, b->br_tail, __ATOMIC_RELEASE);
+
+    if (unlikely(b->br_starved) && b->br_nfree <= b->br_mask) {
+        b->br_starved = false;
+        struct w_sock * s;
+        sl_foreach (s, &b->socks, __next)
+            if (s->__rx_armed == false)
+                arm_rx(s);
+    }
+}
+
+
+/// Handle the completion of a multishot recvmsg. Places the received packet (if
+/// any) into w_sock::iv and re-arms the receive if the kernel ended it.
+///
+/// @param      w     Backend engine.
+/// @param[in]  cqe   The completion queue entry.
+///
+static void __attribute__((nonnull))
+rx_cqe(struct w_engine * const w, const struct io_uring_cqe * const cqe)
+{
+    struct w_backend * const b = w->b;
+    struct w_sock * const s =
+        (struct w_sock *)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+
+    if (likely(cqe->flags & IORING_CQE_F_BUFFER)) {
+        const uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        struct w_iov * const v = b->br_iov[bid];
+        b->br_iov[bid] = 0;
+        b->br_free[b->br_nfree++] = bid;
+
+        if (likely(cqe->res >= (int)URING_RX_HDR)) {
+            struct io_uring_recvmsg_out * const out = (void *)v->base;
+            struct sockaddr * const sa = (void *)(out + 1);
+            v->wv_port = sa_port(sa);
+            w_to_waddr(&v->wv_addr, sa);
+            struct msghdr mh = {.msg_control = (uint8_t *)sa + URING_NAME_LEN,
+                                .msg_controllen = out->controllen};
+            rx_cmsg(&mh, v);
+            v->buf = v->base + URING_RX_HDR;
+            v->len = (uint16_t)((uint32_t)cqe->res - URING_RX_HDR);
+            sq_insert_tail(&s->iv, v, next);
+        } else
+            w_free_iov(v);
+    }
+
+    if (cqe->flags & IORING_CQE_F_MORE)
+        return;
+
+    // the kernel ended the multishot recvmsg
+    s->__rx_armed = false;
+    if (unlikely(s == b->closing))
+        return;
+    if (cqe->res == -ENOBUFS) {
+        // re-arm once refill() had buffers to give
+        b->br_starved = true;
+        return;
+    }
+    if (unlikely(cqe->res < 0))
+        warn(ERR, "multishot recvmsg returned %d (%s)", -cqe->res,
+             strerror(-cqe->res));
+    arm_rx(s);
+}
+
+
+/// Handle the completion of a POLLOUT poll on a w_sock that was blocked on
+/// transmit, so that w_nic_rx() and w_rx_ready() report it.
+///
+/// @param      w     Backend engine.
+/// @param[in]  cqe   The completion queue entry.
+///
+static void __attribute__((nonnull))
+poll_cqe(struct w_engine * const w, const struct io_uring_cqe * const cqe)
+{
+    struct w_sock * const s =
+        (struct w_sock *)(uintptr_t)(cqe->user_data & ~(uint64_t)OP_MASK);
+    s->tx_blocked = false;
+    if (likely(cqe->res >= 0) && s != w->b->closing)
+        s->__tx_ready = true;
+}
+
+
+/// Process all entries in the completion queue.
+///
+/// @param      w     Backend engine.
+///
+static void __attribute__((nonnull)) reap(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    uint32_t head = *b->cq_head;
+    const uint32_t tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe * const cqe = &b->cqe[head & b->cq_mask];
+        switch (cqe->user_data & OP_MASK) {
+        case OP_RX:
+            rx_cqe(w, cqe);
+            break;
+        case OP_TX:
+            b->tx_res[cqe->user_data >> 2] = cqe->res;
+            b->tx_pending--;
+            break;
+        case OP_POLL:
+            poll_cqe(w, cqe);
+            break;
+        default:
+            b->cancel_done = true;
+        }
+    }
+    __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+    refill(w);
+}
+
+
+/// Return whether any w_sock of the engine has received data waiting in
+/// w_sock::iv, or has become writable after being blocked on transmit.
+///
+/// @param[in]  b     Backend.
+///
+/// @return     True if data is waiting or a w_sock became writable.
+///
+static bool __attribute__((nonnull)) rx_pending(const struct w_backend * const b)
+{
+    const struct w_sock * s;
+    sl_foreach (s, &b->socks, __next)
+        if (!sq_empty(&s->iv) || s->__tx_ready)
+            return true;
+    return false;
+}
+
+
+/// Set up the io_uring for engine @p w. Registers the packet buffer memory as
+/// fixed buffers and creates the provided buffer ring for multishot RX, filled
+/// with a quarter of the @p nbufs packet buffers.
+///
+/// @param      w      Backend engine.
+/// @param[in]  nbufs  Number of packet buffers in w_engine::mem.
+///
+void uring_init(struct w_engine * const w, const uint32_t nbufs)
+{
+    struct w_backend * const b = w->b;
+
+    uint32_t br_entries = 1;
+    while (br_entries * 2 <= MIN(nbufs / 4, BR_MAX_ENTRIES))
+        br_entries *= 2;
+
+    // every provided buffer can produce a CQE, so size the CQ accordingly
+    struct io_uring_params p = {.flags = IORING_SETUP_CQSIZE |
+                                         IORING_SETUP_COOP_TASKRUN,
+                                .cq_entries = MAX(2 * SQ_ENTRIES,
+                                                  2 * br_entries)};
+    b->ring = (int)syscall(__NR_io_uring_setup, SQ_ENTRIES, &p);
+    if (b->ring < 0 && errno == EINVAL) {
+        // kernels before 5.19 don't know IORING_SETUP_COOP_TASKRUN
+        p = (struct io_uring_params){.flags = IORING_SETUP_CQSIZE,
+                                     .cq_entries = p.cq_entries};
+        b->ring = (int)syscall(__NR_io_uring_setup, SQ_ENTRIES, &p);
+    }
+    ensure(b->ring >= 0, "cannot set up io_uring (%s)", strerror(errno));
+
+    // map the rings
+    b->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    b->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(*b->cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        b->sq_ring_len = b->cq_ring_len = MAX(b->sq_ring_len, b->cq_ring_len);
+    b->sq_ring = mmap(0, b->sq_ring_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_SQ_RING);
+    ensure(b->sq_ring != MAP_FAILED, "cannot mmap SQ ring");
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        b->cq_ring = b->sq_ring;
+    else {
+        b->cq_ring =
+            mmap(0, b->cq_ring_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_CQ_RING);
+        ensure(b->cq_ring != MAP_FAILED, "cannot mmap CQ ring");
+    }
+    b->sqe_len = p.sq_entries * sizeof(*b->sqe);
+    b->sqe = mmap(0, b->sqe_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_SQES);
+    ensure(b->sqe != MAP_FAILED, "cannot mmap SQEs");
+
+    uint8_t * const sq = b->sq_ring;
+    b->sq_head = (void *)(sq + p.sq_off.head);
+    b->sq_tail = (void *)(sq + p.sq_off.tail);
+    b->sq_mask = *(uint32_t *)(void *)(sq + p.sq_off.ring_mask);
+    b->sq_entries = p.sq_entries;
+    b->sq_local = *b->sq_tail;
+    // SQEs are always used in order
+    uint32_t * const array = (void *)(sq + p.sq_off.array);
+    for (uint32_t i = 0; i < p.sq_entries; i++)
+        array[i] = i;
+
+    uint8_t * const cq = b->cq_ring;
+    b->cq_head = (void *)(cq + p.cq_off.head);
+    b->cq_tail = (void *)(cq + p.cq_off.tail);
+    b->cq_mask = *(uint32_t *)(void *)(cq + p.cq_off.ring_mask);
+    b->cqe = (void *)(cq + p.cq_off.cqes);
+
+    ensure((b->tx_res = calloc(p.sq_entries, sizeof(*b->tx_res))) != 0,
+           "cannot alloc tx_res");
+
+    // register the buffer memory, split into chunks holding whole buffers
+    b->fixed_bufs = (uint32_t)(FIXED_MAX_LEN / max_buf_len(w));
+    const uint32_t nfixed = (nbufs + b->fixed_bufs - 1) / b->fixed_bufs;
+    struct iovec * const fixed = calloc(nfixed, sizeof(*fixed));
+    ensure(fixed, "cannot alloc fixed");
+    for (uint32_t i = 0; i < nfixed; i++) {
+        const uint32_t n = MIN(b->fixed_bufs, nbufs - i * b->fixed_bufs);
+        fixed[i] = (struct iovec){.iov_base = idx_to_buf(w, i * b->fixed_bufs),
+                                  .iov_len = (size_t)n * max_buf_len(w)};
+    }
+    if (syscall(__NR_io_uring_register, b->ring, IORING_REGISTER_BUFFERS, fixed,
+                nfixed) < 0) {
+        warn(WRN, "cannot register fixed buffers (%s)", strerror(errno));
+        b->fixed_bufs = 0;
+    } else
+        b->fixed_len = (size_t)nbufs * max_buf_len(w);
+    free(fixed);
+
+    // set up the provided buffer ring
+    b->br_len = br_entries * sizeof(struct io_uring_buf);
+    b->br = mmap(0, b->br_len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ensure(b->br != MAP_FAILED, "cannot mmap buffer ring");
+    struct io_uring_buf_reg reg = {.ring_addr = (uintptr_t)b->br,
+                                   .ring_entries = br_entries,
+                                   .bgid = 0};
+    ensure(syscall(__NR_io_uring_register, b->ring, IORING_REGISTER_PBUF_RING,
+                   &reg, 1) == 0,
+           "cannot register buffer ring (%s)", strerror(errno));
+    b->br_mask = (uint16_t)(br_entries - 1);
+    ensure((b->br_iov = calloc(br_entries, sizeof(*b->br_iov))) != 0,
+           "cannot alloc br_iov");
+    ensure((b->br_free = calloc(br_entries, sizeof(*b->br_free))) != 0,
+           "cannot alloc br_free");
+    for (uint32_t i = 0; i < br_entries; i++)
+        b->br_free[b->br_nfree++] = (uint16_t)i;
+    refill(w);
+
+    b->rx_msg = (struct msghdr){.msg_namelen = URING_NAME_LEN,
+                                .msg_controllen = URING_CTRL_LEN};
+
+    warn(DBG, "io_uring with %u SQEs, %u CQEs, %u RX bufs, %s fixed bufs",
+         p.sq_entries, p.cq_entries, br_entries,
+         b->fixed_bufs ? "with" : "without");
+}
+
+
+/// Tear down the io_uring of engine @p w.
+///
+/// @param      w     Backend engine.
+///
+void uring_cleanup(struct w_engine * const w)
+{
+    struct w_backend * const b = w->b;
+    for (uint32_t bid = 0; bid <= b->br_mask; bid++)
+        if (b->br_iov[bid])
+            w_free_iov(b->br_iov[bid]);
+    free(b->br_iov);
+    free(b->br_free);
+    free(b->tx_res);
+
+    // closing the ring unregisters everything
+    close(b->ring);
+    munmap(b->br, b->br_len);
+    munmap(b->sqe, b->sqe_len);
+    if (b->cq_ring != b->sq_ring)
+        munmap(b->cq_ring, b->cq_ring_len);
+    munmap(b->sq_ring, b->sq_ring_len);
+}
+
+
+/// Start receiving on the newly bound w_sock @p s.
+///
+/// @param      s     The w_sock.
+///
+void uring_bind(struct w_sock * const s)
+{
+    sl_insert_head(&s->w->b->socks, s, __next);
+    arm_rx(s);
+    enter(s->w->b, 0, 0);
+}
+
+
+/// Stop receiving on w_sock @p s, waiting until the kernel is done with the
+/// multishot recvmsg and any POLLOUT poll. Returns any unread data to the
+/// engine.
+///
+/// @param      s     The w_sock.
+///
+void uring_close(struct w_sock * const s)
+{
+    struct w_engine * const w = s->w;
+    struct w_backend * const b = w->b;
+    sl_remove(&b->socks, s, w_sock, __next);
+
+    if (s->__rx_armed || s->tx_blocked) {
+        b->closing = s;
+        b->cancel_done = false;
+        struct io_uring_sqe * const sqe = get_sqe(b);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = (int)s->fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = OP_CANCEL;
+        while (b->cancel_done == false || s->__rx_armed || s->tx_blocked) {
+            enter(b, 1, 0);
+            reap(w);
+        }
+        b->closing = 0;
+    }
+    w_free(&s->iv);
+}
+
+
+/// Ask to be notified when w_sock @p s, which is blocked on transmit, becomes
+/// writable again.
+///
+/// @param      s     The w_sock.
+///
+void uring_want_tx(struct w_sock * const s)
+{
+    struct io_uring_sqe * const sqe = get_sqe(s->w->b);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = (int)s->fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = (uintptr_t)s | OP_POLL;
+    enter(s->w->b, 0, 0);
+}
+
+
+/// Send @p vlen messages over w_sock @p s, with the same semantics as
+/// sendmmsg() with MSG_DONTWAIT. All messages are submitted with one
+/// io_uring_enter() call, and linked so they go out in order. Connected
+/// messages without control data are sent with IORING_OP_WRITE_FIXED from the
+/// registered buffers.
+///
+/// @param      s       The w_sock to send over.
+/// @param      msgvec  The messages to send.
+/// @param[in]  vlen    The number of messages in @p msgvec.
+///
+/// @return     The number of messages sent, or -1 with errno set if the first
+///             message could not be sent.
+///
+int uring_sendmmsg(struct w_sock * const s,
+                   struct mmsghdr * const msgvec,
+                   const unsigned int vlen)
+{
+    struct w_engine * const w = s->w;
+    struct w_backend * const b = w->b;
+    const uint8_t * const mem = w->mem;
+    assure(vlen <= b->sq_entries, "too many messages");
+
+    for (unsigned int j = 0; j < vlen; j++) {
+        struct msghdr * const mh = &msgvec[j].msg_hdr;
+        const struct iovec * const iov = mh->msg_iov;
+        const uint8_t * const base = iov->iov_base;
+        struct io_uring_sqe * const sqe = get_sqe(b);
+        if (b->fixed_bufs && mh->msg_name == 0 && mh->msg_control == 0 &&
+            mh->msg_iovlen == 1 && base >= mem &&
+            base + iov->iov_len <= mem + b->fixed_len) {
+            const uint32_t idx = (uint32_t)((base - mem) / max_buf_len(w));
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = (uintptr_t)base;
+            sqe->len = (uint32_t)iov->iov_len;
+            sqe->buf_index = (uint16_t)(idx / b->fixed_bufs);
+            sqe->rw_flags = RWF_NOWAIT;
+        } else {
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = (uintptr_t)mh;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_DONTWAIT;
+        }
+        sqe->fd = (int)s->fd;
+        sqe->flags = j + 1 < vlen ? IOSQE_IO_LINK : 0;
+        sqe->user_data = ((uint64_t)j << 2) | OP_TX;
+    }
+
+    // wait for all sends to complete, so the caller can reuse the buffers
+    b->tx_pending = vlen;
+    while (b->tx_pending) {
+        enter(b, b->tx_pending, 0);
+        reap(w);
+    }
+
+    unsigned int n = 0;
+    while (n < vlen && b->tx_res[n] >= 0)
+        n++;
+    if (unlikely(n == 0)) {
+        errno = -b->tx_res[0];
+        return -1;
+    }
+    return (int)n;
+}
+
+
+/// Return the data that has arrived on w_sock @p s.
+///
+/// @param      s     w_sock for which the application would like to receive new
+///                   data.
+/// @param      i     w_iov tail queue to append new data to.
+///
+void w_rx(struct w_sock * const s, struct w_iov_sq * const i)
+{
+    s->__tx_ready = false;
+    reap(s->w);
+    if (sq_empty(&s->iv)) {
+        // let the kernel post any completions it has deferred
+        enter(s->w->b, 0, 0);
+        reap(s->w);
+    }
+    sq_concat(i, &s->iv);
+}
+
+
+/// Check/wait until any data has been received, or until a w_sock that was
+/// blocked on transmit has become writable.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+/// @param[out] rcvd  If non-zero, set to whether any data is ready for reading
+///                   (rather than only a w_sock having become writable.)
+///
+/// @return     Whether any data is ready for reading, or any w_sock has become
+///             writable.
+///
+bool backend_nic_rx(struct w_engine * const w,
+                    const int64_t nsec,
+                    bool * const rcvd)
+{
+    struct w_backend * const b = w->b;
+    backend_shrink(w);
+    reap(w);
+    if (rx_pending(b) == false) {
+        enter(b, nsec ? 1 : 0,
+              nsec > 0
+                  ? &(struct __kernel_timespec){.tv_sec = nsec / NS_PER_S,
+                                                .tv_nsec = nsec % NS_PER_S}
+                  : 0);
+        reap(w);
+    }
+
+    if (rcvd) {
+        *rcvd = false;
+        const struct w_sock * s;
+        sl_foreach (s, &b->socks, __next)
+            if (!sq_empty(&s->iv)) {
+                *rcvd = true;
+                break;
+            }
+    }
+    return rx_pending(b);
+}
+
+
+/// Fill a w_sock_slist with pointers to some sockets with pending inbound
+/// data, or that have become writable after w_tx() was blocked on them. Data
+/// can be obtained via w_rx() on each w_sock in the list. Call can optionally
+/// block to wait for at least one ready connection. Will return the number of
+/// ready connections, or zero if none are ready. When the return value is not
+/// zero, a repeated call may return additional ready sockets.
+///
+/// @param[in]  w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of connections that are ready for reading or writing.
+///
+uint32_t w_rx_ready(struct w_engine * const w, struct w_sock_slist * const sl)
+{
+    reap(w);
+    if (rx_pending(w->b) == false) {
+        enter(w->b, 0, 0);
+        reap(w);
+    }
+
+    uint32_t i = 0;
+    struct w_sock * s;
+    sl_foreach (s, &w->b->socks, __next)
+        if (!sq_empty(&s->iv) || s->__tx_ready) {
+            s->__tx_ready = false;
+            sl_insert_head(sl, s, next);
+            i++;
+        }
+    return i;
+}
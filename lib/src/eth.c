@@ -103,18 +103,19 @@ bool eth_tx(struct w_iov * const v)
     // find a tx ring with space
     struct netmap_ring * txr = 0;
     uint32_t r = 0;
-    for (; likely(r < b->nif->ni_tx_rings); r++) {
-        txr = NETMAP_TXRING(b->nif, b->cur_txr);
+    for (; likely(r < b->ntxr); r++) {
+        txr = NETMAP_TXRING(b->nif, b->first_ring + b->cur_txr);
         if (likely(!nm_ring_empty(txr)))
             // we have space in this ring
             break;
 
-        warn(INF, "tx ring %u full; moving to next", b->cur_txr);
-        b->cur_txr = (b->cur_txr + 1) % b->nif->ni_tx_rings;
+        warn(INF, "tx ring %u full; moving to next",
+             b->first_ring + b->cur_txr);
+        b->cur_txr = (b->cur_txr + 1) % b->ntxr;
     }
 
-    // return false if all rings are full
-    if (unlikely(r == b->nif->ni_tx_rings)) {
+    // return false if all (registered) rings are full
+    if (unlikely(r == b->ntxr)) {
         warn(NTE, "all tx rings are full");
         return false;
     }
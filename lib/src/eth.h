@@ -93,12 +93,15 @@ mk_eth_hdr(const struct w_sock * const s, struct w_iov * const v)
     if (w_connected(s))
         eth->dst = s->dmac;
     else {
-        static struct w_addr last_addr = {0};
-        static struct eth_addr last_mac = {{0}};
+        // per thread, since per-ring engines each run on their own
+        static _Thread_local const struct w_engine * last_w = 0;
+        static _Thread_local struct w_addr last_addr = {0};
+        static _Thread_local struct eth_addr last_mac = {{0}};
 
-        if (likely(w_addr_cmp(&last_addr, &v->wv_addr)))
+        if (likely(last_w == s->w && w_addr_cmp(&last_addr, &v->wv_addr)))
             eth->dst = last_mac;
         else {
+            last_w = s->w;
             last_addr = v->wv_addr;
             eth->dst = last_mac = who_has(s->w, &v->wv_addr);
         }
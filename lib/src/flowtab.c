@@ -0,0 +1,363 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include <warpcore/warpcore.h>
+
+#include "flowtab.h"
+
+
+/// Mix the 64-bit word @p x into hash value @p h. Uses the CRC32C instruction
+/// where the target has one, and a multiplicative hash otherwise.
+///
+/// @param[in]  h     Hash value so far.
+/// @param[in]  x     Word to mix in.
+///
+/// @return     New hash value.
+///
+static inline uint32_t __attribute__((always_inline, const))
+mix(const uint32_t h, const uint64_t x)
+{
+#if defined(__SSE4_2__)
+    return (uint32_t)_mm_crc32_u64(h, x);
+#elif defined(__ARM_FEATURE_CRC32)
+    return __crc32cd(h, x);
+#else
+    return (uint32_t)(((h ^ x) * UINT64_C(0x9e3779b97f4a7c15)) >> 32);
+#endif
+}
+
+
+/// Mix the w_sockaddr @p sa into hash value @p h.
+///
+/// @param[in]  h     Hash value so far.
+/// @param[in]  sa    The w_sockaddr to mix in.
+///
+/// @return     New hash value.
+///
+static inline uint32_t __attribute__((always_inline, nonnull))
+hash_sockaddr(const uint32_t h, const struct w_sockaddr * const sa)
+{
+    const uint64_t pa = (uint64_t)sa->port << 16 | (uint64_t)sa->addr.af;
+    if (sa->addr.af == AF_INET)
+        return mix(h, (uint64_t)sa->addr.ip4 << 32 | pa);
+
+    uint64_t a;
+    uint64_t b;
+    memcpy(&a, sa->addr.ip6, sizeof(a));
+    memcpy(&b, &sa->addr.ip6[sizeof(a)], sizeof(b));
+    return mix(mix(mix(h, a), b), pa);
+}
+
+
+/// Return the tag (seven bits of @p h) to store for a key with hash @p h.
+///
+static inline uint8_t __attribute__((always_inline, const))
+tag_of(const uint32_t h)
+{
+    return h & 0x7f;
+}
+
+
+/// Return the group at which the probe sequence for hash @p h starts.
+///
+static inline uint32_t __attribute__((always_inline, nonnull))
+grp_of(const struct flowtab * const ft, const uint32_t h)
+{
+    return (h >> 7) & (ft->ngrp - 1);
+}
+
+
+/// Compare all tags in group @p grp against @p t.
+///
+/// @param[in]  grp   First tag of a group.
+/// @param[in]  t     Tag to look for.
+///
+/// @return     Bit mask of the slots in @p grp whose tag is @p t.
+///
+static inline uint32_t __attribute__((always_inline, nonnull))
+match_tag(const uint8_t * const grp, const uint8_t t)
+{
+#if defined(__SSE2__)
+    const __m128i g = _mm_load_si128((const __m128i *)(const void *)grp);
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(g, _mm_set1_epi8((char)t)));
+#else
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < FT_GROUP; i++)
+        m |= (uint32_t)(grp[i] == t) << i;
+    return m;
+#endif
+}
+
+
+/// Find the free (#FT_EMPTY or #FT_DELETED) slots in group @p grp.
+///
+/// @param[in]  grp   First tag of a group.
+///
+/// @return     Bit mask of the free slots in @p grp.
+///
+static inline uint32_t __attribute__((always_inline, nonnull))
+match_free(const uint8_t * const grp)
+{
+#if defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_load_si128((const __m128i *)(const void *)grp));
+#else
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < FT_GROUP; i++)
+        m |= (uint32_t)(grp[i] >> 7) << i;
+    return m;
+#endif
+}
+
+
+/// Compute the hash of the key of w_sock @p s.
+///
+static inline uint32_t __attribute__((always_inline, nonnull))
+hash_sock(const struct w_sock * const s)
+{
+    const uint32_t h = hash_sockaddr(0, &s->ws_loc);
+    return w_connected(s) ? hash_sockaddr(h, &s->ws_rem) : h;
+}
+
+
+/// Look up the w_sock with hash @p h.
+///
+/// @param      ft      The flowtab.
+/// @param[in]  h       Hash of the key.
+/// @param[in]  local   Local address and port.
+/// @param[in]  remote  Remote address and port, or zero for a bound-only
+///                     w_sock.
+///
+/// @return     The matching w_sock, or zero.
+///
+static inline struct w_sock * __attribute__((always_inline, nonnull(1, 3)))
+find(const struct flowtab * const ft,
+     const uint32_t h,
+     const struct w_sockaddr * const local,
+     const struct w_sockaddr * const remote)
+{
+    const uint8_t t = tag_of(h);
+    uint32_t g = grp_of(ft, h);
+    for (uint32_t step = 1;; step++) {
+        const uint8_t * const grp = &ft->tag[g * FT_GROUP];
+        for (uint32_t m = match_tag(grp, t); m; m &= m - 1) {
+            struct w_sock * const s =
+                ft->sock[g * FT_GROUP + (uint32_t)__builtin_ctz(m)];
+            if (likely(remote ? w_connected(s) &&
+                                    w_sockaddr_cmp(&s->ws_rem, remote) &&
+                                    w_sockaddr_cmp(&s->ws_loc, local)
+                              : !w_connected(s) &&
+                                    w_sockaddr_cmp(&s->ws_loc, local)))
+                return s;
+        }
+        // a probe sequence ends at the first group with an unused slot
+        if (likely(match_tag(grp, FT_EMPTY)))
+            return 0;
+        g = (g + step) & (ft->ngrp - 1);
+    }
+}
+
+
+/// Place w_sock @p s into the first free slot of its probe sequence.
+///
+/// @param      ft    The flowtab.
+/// @param      s     The w_sock to place.
+///
+static void __attribute__((nonnull))
+place(struct flowtab * const ft, struct w_sock * const s)
+{
+    const uint32_t h = hash_sock(s);
+    uint32_t g = grp_of(ft, h);
+    uint32_t m;
+    for (uint32_t step = 1; (m = match_free(&ft->tag[g * FT_GROUP])) == 0;
+         step++)
+        g = (g + step) & (ft->ngrp - 1);
+
+    const uint32_t i = g * FT_GROUP + (uint32_t)__builtin_ctz(m);
+    if (ft->tag[i] == FT_EMPTY)
+        ft->used++;
+    ft->tag[i] = tag_of(h);
+    ft->sock[i] = s;
+    ft->cnt++;
+}
+
+
+/// Re-allocate @p ft so that it is at most half full after the next insertion,
+/// and re-insert all w_socks. Also drops all #FT_DELETED slots.
+///
+/// @param      ft    The flowtab.
+///
+static void __attribute__((nonnull)) resize(struct flowtab * const ft)
+{
+    uint32_t ngrp = 1;
+    while (ngrp * FT_GROUP < (ft->cnt + 1) * 2)
+        ngrp <<= 1;
+
+    const struct flowtab old = *ft;
+    void * tag;
+    ensure(posix_memalign(&tag, 64, ngrp * FT_GROUP) == 0,
+           "cannot alloc %u flowtab groups", ngrp);
+    memset(tag, FT_EMPTY, ngrp * FT_GROUP);
+    *ft = (struct flowtab){.tag = tag, .ngrp = ngrp};
+    ensure((ft->sock = calloc(ngrp * FT_GROUP, sizeof(*ft->sock))) != 0,
+           "cannot alloc %u flowtab slots", ngrp * FT_GROUP);
+
+    struct w_sock * s;
+    flowtab_foreach(&old, s, { place(ft, s); });
+    free(old.tag);
+    free(old.sock);
+}
+
+
+/// Insert w_sock @p s into @p ft, keyed by its four-tuple if it is connected,
+/// and by its local address and port otherwise. There must be no w_sock with
+/// the same key in @p ft.
+///
+/// @param      ft    The flowtab.
+/// @param      s     The w_sock to insert.
+///
+void flowtab_ins(struct flowtab * const ft, struct w_sock * const s)
+{
+    assure(flowtab_get(ft, &s->ws_loc, w_connected(s) ? &s->ws_rem : 0) == 0,
+           "already in flowtab");
+
+    // keep at least one eighth of the slots unused, so probes terminate early
+    if (unlikely((ft->used + 1) * 8 > ft->ngrp * FT_GROUP * 7))
+        resize(ft);
+    place(ft, s);
+}
+
+
+/// Remove w_sock @p s from @p ft.
+///
+/// @param      ft    The flowtab.
+/// @param[in]  s     The w_sock to remove.
+///
+void flowtab_del(struct flowtab * const ft, const struct w_sock * const s)
+{
+    const uint32_t h = hash_sock(s);
+    const uint8_t t = tag_of(h);
+    uint32_t g = grp_of(ft, h);
+    for (uint32_t step = 1; step <= ft->ngrp; step++) {
+        uint8_t * const grp = &ft->tag[g * FT_GROUP];
+        for (uint32_t m = match_tag(grp, t); m; m &= m - 1) {
+            const uint32_t i = g * FT_GROUP + (uint32_t)__builtin_ctz(m);
+            if (ft->sock[i] != s)
+                continue;
+            ft->sock[i] = 0;
+            ft->cnt--;
+            // if this group has an unused slot, no probe sequence continues
+            // past it, and the slot can become unused again
+            if (match_tag(grp, FT_EMPTY)) {
+                ft->tag[i] = FT_EMPTY;
+                ft->used--;
+            } else
+                ft->tag[i] = FT_DELETED;
+            return;
+        }
+        g = (g + step) & (ft->ngrp - 1);
+    }
+    die("w_sock not in flowtab");
+}
+
+
+/// Get the w_sock with the given key.
+///
+/// @param      ft      The flowtab.
+/// @param[in]  local   Local address and port.
+/// @param[in]  remote  Remote address and port of a connected w_sock, or zero
+///                     for a bound-only one.
+///
+/// @return     The w_sock with the given key, or zero.
+///
+struct w_sock * flowtab_get(const struct flowtab * const ft,
+                            const struct w_sockaddr * const local,
+                            const struct w_sockaddr * const remote)
+{
+    if (unlikely(ft->ngrp == 0))
+        return 0;
+    const uint32_t h = hash_sockaddr(0, local);
+    return remote ? find(ft, hash_sockaddr(h, remote), local, remote)
+                  : find(ft, h, local, 0);
+}
+
+
+/// Find the w_sock that should receive a packet from @p remote to @p local,
+/// i.e., the w_sock connected to that four-tuple, or failing that, the w_sock
+/// bound to @p local.
+///
+/// Both hashes come out of one pass over the addresses, since the key of a
+/// bound-only w_sock is a prefix of that of a connected one. The bound-only
+/// probe sequence is prefetched while the connected one is searched.
+///
+/// @param      ft      The flowtab.
+/// @param[in]  local   Local address and port.
+/// @param[in]  remote  Remote address and port.
+///
+/// @return     The w_sock to deliver to, or zero.
+///
+struct w_sock * flowtab_demux(const struct flowtab * const ft,
+                              const struct w_sockaddr * const local,
+                              const struct w_sockaddr * const remote)
+{
+    if (unlikely(ft->ngrp == 0))
+        return 0;
+    const uint32_t hl = hash_sockaddr(0, local);
+    const uint32_t hc = hash_sockaddr(hl, remote);
+    __builtin_prefetch(&ft->tag[grp_of(ft, hl) * FT_GROUP]);
+    struct w_sock * const s = find(ft, hc, local, remote);
+    return likely(s) ? s : find(ft, hl, local, 0);
+}
+
+
+/// Free the memory used by @p ft, leaving it empty.
+///
+/// @param      ft    The flowtab.
+///
+void flowtab_free(struct flowtab * const ft)
+{
+    free(ft->tag);
+    free(ft->sock);
+    *ft = (struct flowtab){0};
+}
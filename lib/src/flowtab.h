@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+
+#define FT_GROUP 16     ///< Slots per group, whose tags are compared at once.
+#define FT_EMPTY 0x80   ///< Tag of a never-used slot.
+#define FT_DELETED 0xfe ///< Tag of a slot whose w_sock was removed.
+
+
+/// Open-addressing hash table that demultiplexes packets to w_socks. Connected
+/// w_socks are keyed by their four-tuple, bound-only ones by their local
+/// address and port.
+///
+/// Slots are organized in groups of #FT_GROUP. Each slot has a one-byte tag,
+/// holding seven bits of the hash of its key, so that a lookup can compare a
+/// whole group of tags at once and only look at the w_socks whose tags match.
+///
+struct flowtab {
+    uint8_t * tag;         ///< Per-slot tags (or #FT_EMPTY or #FT_DELETED.)
+    struct w_sock ** sock; ///< Per-slot w_socks.
+    uint32_t ngrp;         ///< Number of groups (a power of two), or zero.
+    uint32_t cnt;          ///< Number of w_socks in the table.
+    uint32_t used;         ///< Number of slots that are not #FT_EMPTY.
+    /// @cond
+    uint8_t _unused[4]; ///< @internal Padding.
+                        /// @endcond
+};
+
+
+/// Iterate over all w_socks in flowtab @p ft. The body may remove the current
+/// w_sock from @p ft, but must not insert any.
+///
+/// @param      ft    A flowtab.
+/// @param      s     Variable to assign each w_sock to.
+/// @param      code  Code to execute for each w_sock.
+///
+#define flowtab_foreach(ft, s, code)                                           \
+    do {                                                                       \
+        for (uint32_t __i = 0; __i < (ft)->ngrp * FT_GROUP; __i++) {           \
+            if ((ft)->tag[__i] & FT_EMPTY)                                     \
+                continue;                                                      \
+            (s) = (ft)->sock[__i];                                             \
+            code;                                                              \
+        }                                                                      \
+    } while (0)
+
+
+extern void __attribute__((nonnull))
+flowtab_ins(struct flowtab * const ft, struct w_sock * const s);
+
+extern void __attribute__((nonnull))
+flowtab_del(struct flowtab * const ft, const struct w_sock * const s);
+
+extern struct w_sock * __attribute__((nonnull(1, 2)))
+flowtab_get(const struct flowtab * const ft,
+            const struct w_sockaddr * const local,
+            const struct w_sockaddr * const remote);
+
+extern struct w_sock * __attribute__((nonnull))
+flowtab_demux(const struct flowtab * const ft,
+              const struct w_sockaddr * const local,
+              const struct w_sockaddr * const remote);
+
+extern void __attribute__((nonnull)) flowtab_free(struct flowtab * const ft);
@@ -51,13 +51,16 @@
  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
-// #define CHECKSUM_SSE
-
-#ifdef CHECKSUM_SSE
-#include <emmintrin.h>
-#include <smmintrin.h>
+#include <stdbool.h>
 #include <stdint.h>
-#include <tmmintrin.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CKSUM_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CKSUM_ARM64
 #endif
 
 #ifdef __FreeBSD__
@@ -71,13 +74,9 @@
 #include "ip6.h"
 
 
-static inline uint16_t __attribute__((always_inline, const))
-csum_oc16_reduce(uint32_t sum)
-{
-    while (sum >> 16)
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    return (uint16_t)(~sum);
-}
+/// Buffers shorter than this are summed by csum_oc16() directly, since the
+/// SIMD kernels would only sum their tails.
+#define CKSUM_SIMD_MIN 64
 
 
 #ifdef CKSUM_UPDATE
@@ -89,7 +88,7 @@ ip_cksum_update32(uint16_t old_check, uint32_t old_data, uint32_t new_data)
     const uint32_t l = (uint32_t)old_check + (old_data >> 16) +
                        (old_data & 0xffff) + (new_data >> 16) +
                        (new_data & 0xffff);
-    return csum_oc16_reduce(l);
+    return ip_cksum_fold(l);
 }
 
 
@@ -99,19 +98,33 @@ ip_cksum_update16(uint16_t old_check, uint16_t old_data, uint16_t new_data)
     old_check = ~old_check;
     old_data = ~old_data;
     const uint32_t l = (uint32_t)(old_check + ~old_data + new_data);
-    return csum_oc16_reduce(l);
+    return ip_cksum_fold(l);
 }
 #endif
 
 
+/// Sum the 16-bit words (in host byte-order) of buffer @p data of length @p
+/// data_len. A trailing odd byte is summed as if padded with a zero byte.
+///
+/// All kernels below return exactly the same sum as this one, so that
+/// ip_cksum_fold() turns it into the same checksum.
+///
+/// @param[in]  data      The buffer.
+/// @param[in]  data_len  The length of @p data.
+///
+/// @return     Sum of the 16-bit words in @p data.
+///
 static inline uint32_t __attribute__((always_inline))
 csum_oc16(const uint8_t * const restrict data, const uint32_t data_len)
 {
-    const uint16_t * restrict data16 = (const uint16_t *)(const void *)data;
     uint32_t sum = 0;
 
-    for (uint64_t n = 0; n < data_len / sizeof(uint16_t); n++)
-        sum += (uint32_t)data16[n];
+    for (uint64_t n = 0; n < data_len / sizeof(uint16_t); n++) {
+        // data may be unaligned
+        uint16_t w;
+        memcpy(&w, &data[n * sizeof(w)], sizeof(w));
+        sum += (uint32_t)w;
+    }
 
     if (data_len & 1)
         sum += (uint32_t)data[data_len - 1];
@@ -120,207 +133,252 @@ csum_oc16(const uint8_t * const restrict data, const uint32_t data_len)
 }
 
 
-#ifndef CHECKSUM_SSE
-
-/// Compute the Internet checksum over buffer @p buf of length @p len. See
-/// [RFC1071](https://tools.ietf.org/html/rfc1071).
-///
-/// @param[in]  buf   The buffer
-/// @param[in]  len   The length
-///
-/// @return     Internet checksum of @p buf.
-///
-uint16_t ip_cksum(const void * const buf, const uint16_t len)
+static uint32_t csum_oc16_scalar(const uint8_t * const data,
+                                 const uint32_t data_len)
 {
-    const uint32_t sum = csum_oc16(buf, len);
-    return csum_oc16_reduce(sum);
+    return csum_oc16(data, data_len);
 }
 
 
-uint16_t payload_cksum(const void * const buf, const uint16_t len)
-{
-    const uint8_t v = ip_v(*(const uint8_t *)buf);
-    uint16_t ip_hdr_len;
-    uint32_t sum;
+#ifdef CKSUM_X86
+// The x86 kernels add the low and high 16-bit halves of each 32-bit lane into
+// separate 32-bit accumulators. For buffers up to 64KB, no lane can overflow.
 
-    if (v == 4) {
-        const struct ip4_hdr * const ip = buf;
-        ip_hdr_len = ip4_hl(*(const uint8_t *)buf);
-        sum = (uint32_t)ip->p << 8;
-        sum += csum_oc16((const uint8_t *)&ip->src, sizeof(ip->src));
-        sum += csum_oc16((const uint8_t *)&ip->dst, sizeof(ip->dst));
-        const uint16_t plen = bswap16(bswap16(ip->len) - ip_hdr_len);
-        sum += csum_oc16((const uint8_t *)&plen, sizeof(plen));
-    } else {
-        const struct ip6_hdr * const ip = buf;
-        ip_hdr_len = sizeof(*ip);
-        sum = (uint32_t)ip->next_hdr << 24;
-        sum += csum_oc16((const uint8_t *)&ip->src, sizeof(ip->src));
-        sum += csum_oc16((const uint8_t *)&ip->dst, sizeof(ip->dst));
-        sum += csum_oc16((const uint8_t *)&ip->len, sizeof(ip->len));
+static uint32_t __attribute__((target("avx2")))
+csum_oc16_avx2(const uint8_t * const data, const uint32_t data_len)
+{
+    const __m256i lo16 = _mm256_set1_epi32(0xffff);
+    __m256i sum_lo = _mm256_setzero_si256();
+    __m256i sum_hi = _mm256_setzero_si256();
+
+    uint32_t n;
+    for (n = 0; n + 64 <= data_len; n += 64) {
+        const __m256i d0 = _mm256_loadu_si256((const void *)&data[n]);
+        const __m256i d1 = _mm256_loadu_si256((const void *)&data[n + 32]);
+        sum_lo = _mm256_add_epi32(sum_lo, _mm256_and_si256(d0, lo16));
+        sum_hi = _mm256_add_epi32(sum_hi, _mm256_srli_epi32(d0, 16));
+        sum_lo = _mm256_add_epi32(sum_lo, _mm256_and_si256(d1, lo16));
+        sum_hi = _mm256_add_epi32(sum_hi, _mm256_srli_epi32(d1, 16));
+    }
+    if (n + 32 <= data_len) {
+        const __m256i d = _mm256_loadu_si256((const void *)&data[n]);
+        sum_lo = _mm256_add_epi32(sum_lo, _mm256_and_si256(d, lo16));
+        sum_hi = _mm256_add_epi32(sum_hi, _mm256_srli_epi32(d, 16));
+        n += 32;
     }
 
-    // payload
-    sum += csum_oc16((const uint8_t *)buf + ip_hdr_len, len - ip_hdr_len);
-
-    return csum_oc16_reduce(sum);
+    const __m256i s = _mm256_add_epi32(sum_lo, sum_hi);
+    __m128i t = _mm_add_epi32(_mm256_castsi256_si128(s),
+                              _mm256_extracti128_si256(s, 1));
+    t = _mm_add_epi32(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(1, 0, 3, 2)));
+    t = _mm_add_epi32(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(t) + csum_oc16(&data[n], data_len - n);
 }
 
-#else
-
-#define DECLARE_ALIGNED(_declaration, _boundary)                               \
-    _declaration __attribute__((aligned(_boundary)))
 
-static const DECLARE_ALIGNED(uint8_t crc_xmm_shift_tab[48], 16) = {
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-
-
-static inline __m128i __attribute__((always_inline))
-xmm_shift_right(const __m128i reg, const unsigned int num)
+static uint32_t __attribute__((target("avx512f")))
+csum_oc16_avx512(const uint8_t * const data, const uint32_t data_len)
 {
-    const __m128i * p =
-        (const __m128i *)(const void *)(crc_xmm_shift_tab + 16 + num);
-    return _mm_shuffle_epi8(reg, _mm_loadu_si128(p));
+    const __m512i lo16 = _mm512_set1_epi32(0xffff);
+    __m512i sum_lo = _mm512_setzero_si512();
+    __m512i sum_hi = _mm512_setzero_si512();
+
+    uint32_t n;
+    for (n = 0; n + 128 <= data_len; n += 128) {
+        const __m512i d0 = _mm512_loadu_si512((const void *)&data[n]);
+        const __m512i d1 = _mm512_loadu_si512((const void *)&data[n + 64]);
+        sum_lo = _mm512_add_epi32(sum_lo, _mm512_and_si512(d0, lo16));
+        sum_hi = _mm512_add_epi32(sum_hi, _mm512_srli_epi32(d0, 16));
+        sum_lo = _mm512_add_epi32(sum_lo, _mm512_and_si512(d1, lo16));
+        sum_hi = _mm512_add_epi32(sum_hi, _mm512_srli_epi32(d1, 16));
+    }
+    if (n + 64 <= data_len) {
+        const __m512i d = _mm512_loadu_si512((const void *)&data[n]);
+        sum_lo = _mm512_add_epi32(sum_lo, _mm512_and_si512(d, lo16));
+        sum_hi = _mm512_add_epi32(sum_hi, _mm512_srli_epi32(d, 16));
+        n += 64;
+    }
+
+    return (uint32_t)_mm512_reduce_add_epi32(
+               _mm512_add_epi32(sum_lo, sum_hi)) +
+           csum_oc16(&data[n], data_len - n);
 }
 
+#elif defined(CKSUM_ARM64)
 
-static inline __m128i __attribute__((always_inline))
-xmm_shift_left(const __m128i reg, const unsigned int num)
+static uint32_t csum_oc16_neon(const uint8_t * const data,
+                               const uint32_t data_len)
 {
-    const __m128i * p =
-        (const __m128i *)(const void *)(crc_xmm_shift_tab + 16 - num);
-    return _mm_shuffle_epi8(reg, _mm_loadu_si128(p));
-}
+    uint32x4_t sum0 = vdupq_n_u32(0);
+    uint32x4_t sum1 = vdupq_n_u32(0);
+
+    uint32_t n;
+    for (n = 0; n + 64 <= data_len; n += 64) {
+        // pairwise-add adjacent 16-bit words into the 32-bit accumulators
+        sum0 = vpadalq_u16(sum0, vreinterpretq_u16_u8(vld1q_u8(&data[n])));
+        sum1 = vpadalq_u16(sum1, vreinterpretq_u16_u8(vld1q_u8(&data[n + 16])));
+        sum0 = vpadalq_u16(sum0, vreinterpretq_u16_u8(vld1q_u8(&data[n + 32])));
+        sum1 = vpadalq_u16(sum1, vreinterpretq_u16_u8(vld1q_u8(&data[n + 48])));
+    }
+    for (; n + 16 <= data_len; n += 16)
+        sum0 = vpadalq_u16(sum0, vreinterpretq_u16_u8(vld1q_u8(&data[n])));
 
+    return vaddvq_u32(vaddq_u32(sum0, sum1)) +
+           csum_oc16(&data[n], data_len - n);
+}
 
-static __m128i swap16a;
-static __m128i swap16b;
-static __m128i udp_mask;
+#endif
 
 
-static void __attribute__((constructor)) cksum_sse_init(void)
-{
-    swap16a = _mm_setr_epi16((short)0x0001, (short)0xffff, (short)0x0203,
-                             (short)0xffff, (short)0x0405, (short)0xffff,
-                             (short)0x0607, (short)0xffff);
-
-    swap16b = _mm_setr_epi16((short)0x0809, (short)0xffff, (short)0x0a0b,
-                             (short)0xffff, (short)0x0c0d, (short)0xffff,
-                             (short)0x0e0f, (short)0xffff);
-
-    udp_mask = _mm_setr_epi8((char)0x01, (char)0x00, (char)0xff, (char)0xff,
-                             (char)0x03, (char)0x02, (char)0xff, (char)0xff,
-                             (char)0x05, (char)0x04, (char)0xff, (char)0xff,
-                             (char)0x05, (char)0x04, (char)0xff, (char)0xff);
-}
+/// The kernel ip_cksum() and payload_cksum() use for longer buffers.
+static uint32_t (*csum_oc16_simd)(const uint8_t * const data,
+                                  const uint32_t data_len) = csum_oc16_scalar;
 
 
-static inline uint32_t __attribute__((always_inline))
-csum_oc16_sse(const uint8_t * const data,
-              const uint32_t data_len,
-              __m128i sum32a,
-              __m128i sum32b)
+/// Select the checksum kernel that ip_cksum() and payload_cksum() use. This is
+/// mostly useful for testing, since the fastest kernel the CPU supports is
+/// selected on startup.
+///
+/// @param[in]  impl  One of the CKSUM_* kernels, or CKSUM_AUTO.
+///
+/// @return     Whether the CPU (and compiler) support kernel @p impl.
+///
+bool cksum_use(const uint8_t impl)
 {
-    uint32_t n = 0;
-    for (n = 0; (n + 64) <= data_len; n += 64) {
-        __m128i dblock1;
-        __m128i dblock2;
-
-        dblock1 = _mm_loadu_si128((const __m128i *)(const void *)&data[n]);
-        dblock2 = _mm_loadu_si128((const __m128i *)(const void *)&data[n + 16]);
-
-        sum32a = _mm_add_epi32(sum32a, _mm_shuffle_epi8(dblock1, swap16a));
-        sum32b = _mm_add_epi32(sum32b, _mm_shuffle_epi8(dblock1, swap16b));
-        sum32a = _mm_add_epi32(sum32a, _mm_shuffle_epi8(dblock2, swap16a));
-        sum32b = _mm_add_epi32(sum32b, _mm_shuffle_epi8(dblock2, swap16b));
-
-        dblock1 = _mm_loadu_si128((const __m128i *)(const void *)&data[n + 32]);
-        dblock2 = _mm_loadu_si128((const __m128i *)(const void *)&data[n + 48]);
-
-        sum32a = _mm_add_epi32(sum32a, _mm_shuffle_epi8(dblock1, swap16a));
-        sum32b = _mm_add_epi32(sum32b, _mm_shuffle_epi8(dblock1, swap16b));
-        sum32a = _mm_add_epi32(sum32a, _mm_shuffle_epi8(dblock2, swap16a));
-        sum32b = _mm_add_epi32(sum32b, _mm_shuffle_epi8(dblock2, swap16b));
-    }
-
-    while ((n + 16) <= data_len) {
-        __m128i dblock;
+    switch (impl) {
+    case CKSUM_AUTO:
+#ifdef CKSUM_X86
+        if (cksum_use(CKSUM_AVX512))
+            return true;
+        if (cksum_use(CKSUM_AVX2))
+            return true;
+#elif defined(CKSUM_ARM64)
+        if (cksum_use(CKSUM_NEON))
+            return true;
+#endif
+        return cksum_use(CKSUM_SCALAR);
+
+    case CKSUM_SCALAR:
+        csum_oc16_simd = csum_oc16_scalar;
+        return true;
+
+#ifdef CKSUM_X86
+    case CKSUM_AVX2:
+        if (__builtin_cpu_supports("avx2") == 0)
+            return false;
+        csum_oc16_simd = csum_oc16_avx2;
+        return true;
+
+    case CKSUM_AVX512:
+        if (__builtin_cpu_supports("avx512f") == 0)
+            return false;
+        csum_oc16_simd = csum_oc16_avx512;
+        return true;
+#elif defined(CKSUM_ARM64)
+    case CKSUM_NEON:
+        csum_oc16_simd = csum_oc16_neon;
+        return true;
+#endif
 
-        dblock = _mm_loadu_si128((const __m128i *)(const void *)&data[n]);
-        sum32a = _mm_add_epi32(sum32a, _mm_shuffle_epi8(dblock, swap16a));
-        sum32b = _mm_add_epi32(sum32b, _mm_shuffle_epi8(dblock, swap16b));
-        n += 16;
+    default:
+        return false;
     }
+}
 
-    if (likely(n != data_len)) {
-        __m128i dblock;
 
-        dblock = _mm_loadu_si128((const __m128i *)(const void *)&data[n]);
-        dblock = xmm_shift_left(dblock, 16 - (data_len & 15));
-        dblock = xmm_shift_right(dblock, 16 - (data_len & 15));
-        sum32a = _mm_add_epi32(sum32a, _mm_shuffle_epi8(dblock, swap16a));
-        sum32b = _mm_add_epi32(sum32b, _mm_shuffle_epi8(dblock, swap16b));
-    }
+static void __attribute__((constructor)) cksum_init(void)
+{
+#ifdef CKSUM_X86
+    __builtin_cpu_init();
+#endif
+    cksum_use(CKSUM_AUTO);
+}
+
 
-    sum32a = _mm_add_epi32(sum32a, sum32b);
-    sum32a = _mm_hadd_epi32(sum32a, _mm_setzero_si128());
-    sum32a = _mm_hadd_epi32(sum32a, _mm_setzero_si128());
-    return (uint32_t)_mm_extract_epi32(sum32a, 0);
+/// Sum the 16-bit words of buffer @p data of length @p data_len, with the
+/// selected kernel for longer buffers.
+///
+/// @param[in]  data      The buffer.
+/// @param[in]  data_len  The length of @p data.
+///
+/// @return     Sum of the 16-bit words in @p data.
+///
+static inline uint32_t __attribute__((always_inline))
+csum_oc16_any(const uint8_t * const data, const uint32_t data_len)
+{
+    return data_len < CKSUM_SIMD_MIN ? csum_oc16(data, data_len)
+                                     : csum_oc16_simd(data, data_len);
 }
 
 
+/// Compute the Internet checksum over buffer @p buf of length @p len. See
+/// [RFC1071](https://tools.ietf.org/html/rfc1071).
+///
+/// @param[in]  buf   The buffer
+/// @param[in]  len   The length
+///
+/// @return     Internet checksum of @p buf.
+///
 uint16_t ip_cksum(const void * const buf, const uint16_t len)
 {
-    const uint32_t sum =
-        csum_oc16_sse(buf, len, _mm_setzero_si128(), _mm_setzero_si128());
+    const uint32_t sum = csum_oc16_any(buf, len);
+    return ip_cksum_fold(sum);
+}
 
-    return bswap16(csum_oc16_reduce(sum));
+
+/// Compute the one's complement sum of the 16-bit words in buffer @p buf of
+/// length @p len, without folding it into a checksum. Partial sums of buffers
+/// that start at even offsets into a packet can be added up, and then be folded
+/// with ip_cksum_fold().
+///
+/// @param[in]  buf   The buffer.
+/// @param[in]  len   The length of @p buf.
+///
+/// @return     Partial sum of @p buf.
+///
+uint32_t ip_cksum_partial(const void * const buf, const uint16_t len)
+{
+    return csum_oc16_any(buf, len);
 }
 
 
+/// Compute the UDP or ICMPv6 checksum over the IPv4 or IPv6 packet in @p buf of
+/// length @p len, including the pseudo header.
+///
+/// @param[in]  buf   The IP packet.
+/// @param[in]  len   The length of @p buf.
+///
+/// @return     Checksum of the IP payload in @p buf.
+///
 uint16_t
 #if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
     __attribute__((no_sanitize("alignment")))
 #endif
-    udp_cksum(const void * const buf, const uint16_t len)
+    payload_cksum(const void * const buf, const uint16_t len)
 {
-    const struct ip4_hdr * ip = (const struct ip4_hdr *)buf;
-    __m128i sum32a;
-    __m128i sum32b;
+    const uint8_t v = ip_v(*(const uint8_t *)buf);
+    uint16_t ip_hdr_len;
     uint32_t sum;
 
-    /**
-     * Do pseudo IPv4 header
-     * Load source and destination addresses from IP header
-     * Swap 16-bit words from big endian to little endian
-     * Extend 16 bit words to 32 bit words for further with SSE
-     */
-    sum32a = _mm_loadu_si128(
-        (const __m128i *)(const void *)((const uint8_t *)buf +
-                                        __builtin_offsetof(struct ip4_hdr,
-                                                           src)));
-    sum32a = _mm_shuffle_epi8(sum32a, swap16a);
-
-    /**
-     * Read UDP header
-     * Duplicate length field as it wasn't included in IPv4 pseudo header
-     * Swap 16-bit words from big endian to little endian
-     * Extend 16 bit words to 32 bit words for further with SSE
-     */
-    sum32b = _mm_loadu_si128(
-        (const __m128i *)(const void *)((const uint8_t *)buf +
-                                        sizeof(struct ip4_hdr)));
-    sum32b = _mm_shuffle_epi8(sum32b, udp_mask);
-
-    sum = csum_oc16_sse((const uint8_t *)buf + sizeof(struct ip4_hdr) +
-                            sizeof(struct udp_hdr),
-                        len - sizeof(struct ip4_hdr) - sizeof(struct udp_hdr),
-                        sum32a, sum32b) +
-          ((uint32_t)ip->p);
-
-    return bswap16(csum_oc16_reduce(sum));
+    if (v == 4) {
+        const struct ip4_hdr * const ip = buf;
+        ip_hdr_len = ip4_hl(*(const uint8_t *)buf);
+        sum = (uint32_t)ip->p << 8;
+        sum += csum_oc16((const uint8_t *)&ip->src, sizeof(ip->src));
+        sum += csum_oc16((const uint8_t *)&ip->dst, sizeof(ip->dst));
+        const uint16_t plen = bswap16(bswap16(ip->len) - ip_hdr_len);
+        sum += csum_oc16((const uint8_t *)&plen, sizeof(plen));
+    } else {
+        const struct ip6_hdr * const ip = buf;
+        ip_hdr_len = sizeof(*ip);
+        sum = (uint32_t)ip->next_hdr << 24;
+        sum += csum_oc16((const uint8_t *)&ip->src, sizeof(ip->src));
+        sum += csum_oc16((const uint8_t *)&ip->dst, sizeof(ip->dst));
+        sum += csum_oc16((const uint8_t *)&ip->len, sizeof(ip->len));
+    }
+
+    // payload
+    sum += csum_oc16_any((const uint8_t *)buf + ip_hdr_len, len - ip_hdr_len);
+
+    return ip_cksum_fold(sum);
 }
-#endif
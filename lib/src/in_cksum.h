@@ -27,8 +27,35 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#define CKSUM_AUTO 0   ///< Fastest checksum kernel the CPU supports.
+#define CKSUM_SCALAR 1 ///< Portable checksum kernel.
+#define CKSUM_AVX2 2   ///< x86 AVX2 checksum kernel.
+#define CKSUM_AVX512 3 ///< x86 AVX-512 checksum kernel.
+#define CKSUM_NEON 4   ///< ARMv8 NEON checksum kernel.
+
+extern bool cksum_use(const uint8_t impl);
+
+
+/// Fold the 32-bit one's complement sum @p sum into an Internet checksum.
+///
+/// @param[in]  sum   Sum of 16-bit words, e.g., from ip_cksum_partial().
+///
+/// @return     Internet checksum.
+///
+static inline uint16_t __attribute__((always_inline, const))
+ip_cksum_fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)(~sum);
+}
+
+extern uint32_t __attribute__((nonnull))
+ip_cksum_partial(const void * const buf, const uint16_t len);
+
 extern uint16_t __attribute__((nonnull))
 ip_cksum(const void * const buf, const uint16_t len);
 
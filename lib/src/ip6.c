@@ -135,7 +135,7 @@ void
             (uint32_t)((v->flags & 0x0f) << 12 | (v->flags & 0xf0) >> 4);
     else if (likely(s) && s->opt.enable_ecn)
         // if there is no per-packet ECN marking, apply default
-        ip->vtcecnfl |= (ECN_ECT0 << 20);
+        ip->vtcecnfl |= (ECN_ECT0 << 12);
 
     // we never set a flow label, if we were to set it, do it like this:
     // uint32_t flow = 0x00012345;
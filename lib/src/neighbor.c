@@ -25,6 +25,7 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <pthread.h>
 #include <string.h>
 
 #include <stdlib.h>
@@ -39,7 +40,7 @@
 
 
 /// Update the MAC address associated with IP address @p addr in the neighbor
-/// cache.
+/// cache. The cache is shared by all engines in the nm_group of @p w.
 ///
 /// @param      w     Backend engine.
 /// @param[in]  addr  IP address to update the neighbor cache for.
@@ -49,16 +50,19 @@ void neighbor_update(struct w_engine * const w,
                      const struct w_addr * const addr,
                      const struct eth_addr mac)
 {
-    khiter_t k = kh_get(neighbor, &w->b->neighbor, addr);
-    if (k == kh_end(&w->b->neighbor)) {
+    struct nm_group * const g = w->b->grp;
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    khiter_t k = kh_get(neighbor, &g->neighbor, addr);
+    if (k == kh_end(&g->neighbor)) {
         struct w_addr * const a = malloc(sizeof(*addr));
         ensure(a, "could not malloc");
         memcpy(a, addr, sizeof(*addr));
         int ret;
-        k = kh_put(neighbor, &w->b->neighbor, a, &ret); // NOLINT
+        k = kh_put(neighbor, &g->neighbor, a, &ret); // NOLINT
         assure(ret >= 1, "inserted");
     }
-    kh_val(&w->b->neighbor, k) = mac;
+    kh_val(&g->neighbor, k) = mac;
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
 
     warn(INF, "neighbor cache entry: %s is at %s", w_ntop(addr, ip_tmp),
          eth_ntoa(&mac, eth_tmp, ETH_STRLEN));
@@ -75,17 +79,22 @@ void neighbor_update(struct w_engine * const w,
 static struct eth_addr __attribute__((nonnull))
 neighbor_find(struct w_engine * const w, const struct w_addr * const addr)
 {
-    const khiter_t k = kh_get(neighbor, &w->b->neighbor, addr);
-    if (unlikely(k == kh_end(&w->b->neighbor)))
-        return (struct eth_addr){ETH_ADDR_BCAST};
-    return kh_val(&w->b->neighbor, k);
+    struct nm_group * const g = w->b->grp;
+    struct eth_addr a = {ETH_ADDR_BCAST};
+    ensure(pthread_mutex_lock(&g->lock) == 0, "pthread_mutex_lock");
+    const khiter_t k = kh_get(neighbor, &g->neighbor, addr);
+    if (likely(k != kh_end(&g->neighbor)))
+        a = kh_val(&g->neighbor, k);
+    ensure(pthread_mutex_unlock(&g->lock) == 0, "pthread_mutex_unlock");
+    return a;
 }
 
 
 /// Return the Ethernet MAC address for target IP address @p addr. If there is
 /// no entry in the neighbor cache for the Ethernet MAC address corresponding to
 /// IPv4 address @p addr, this function will block while attempting to resolve
-/// the address.
+/// the address. (The reply may also be received by another engine of the
+/// nm_group of @p w, which then updates the shared cache.)
 ///
 /// @param      w     Backend engine.
 /// @param[in]  addr  IP address that is the target of the neighbor request
@@ -118,7 +127,8 @@ struct eth_addr
 }
 
 
-/// Free the neighbor cache entries associated with engine @p w.
+/// Free the neighbor cache entries associated with engine @p w. Must only be
+/// called by the last engine to leave the nm_group of @p w.
 ///
 /// @param[in]  w     Backend engine.
 ///
@@ -128,8 +138,8 @@ void free_neighbor(struct w_engine * const w)
     struct eth_addr v;
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wcast-qual"
-    kh_foreach(&w->b->neighbor, k, v, { free((void *)k); });
+    kh_foreach(&w->b->grp->neighbor, k, v, { free((void *)k); });
 #pragma clang diagnostic pop
 
-    kh_release(neighbor, &w->b->neighbor);
+    kh_release(neighbor, &w->b->grp->neighbor);
 }
@@ -86,8 +86,10 @@
 
 
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
-// w_init() must initialize this so that it is not all zero
-static krng_t w_rand_state;
+// per thread, so that engines on different threads don't race on it; must be
+// seeded so that it is not all zero
+static _Thread_local krng_t w_rand_state;
+static _Thread_local bool w_rand_seeded;
 #endif
 
 
@@ -380,19 +382,23 @@ void w_nanosleep(const uint64_t
 }
 
 
-/// Init state for w_rand() and w_rand_uniform(). This **MUST** be called once
-/// prior to calling any of these functions!
+/// Init state for w_rand() and w_rand_uniform(). The state is per thread, and
+/// is seeded on first use if the thread did not call this.
 ///
 void w_init_rand(void)
 {
     // init state for w_rand()
 #if !defined(FUZZING) && !defined(PARTICLE) && !defined(RIOT_VERSION)
-    struct timeval now;
-    gettimeofday(&now, 0);
-    const uint64_t seed = fnv1a_64(&now, sizeof(now));
-    kr_srand_r(&w_rand_state, seed);
+    struct {
+        struct timeval now;
+        const void * state; // differs between threads seeding at the same time
+    } seed = {.state = &w_rand_state};
+    gettimeofday(&seed.now, 0);
+    kr_srand_r(&w_rand_state, fnv1a_64(&seed, sizeof(seed)));
+    w_rand_seeded = true;
 #elif defined(FUZZING)
     kr_srand_r(&w_rand_state, 1); // NOTE: can we use the cmd line fuzzer seed?
+    w_rand_seeded = true;
 #endif
 }
 
@@ -406,6 +412,8 @@ void w_init_rand(void)
 uint64_t w_rand64(void)
 {
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    if (unlikely(w_rand_seeded == false))
+        w_init_rand();
     return kr_rand_r(&w_rand_state);
 #elif defined(PARTICLE)
     return (uint64_t)(HAL_RNG_GetRandomNumber()) << 32 |
@@ -424,6 +432,8 @@ uint64_t w_rand64(void)
 uint32_t w_rand32(void)
 {
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    if (unlikely(w_rand_seeded == false))
+        w_init_rand();
     return (uint32_t)kr_rand_r(&w_rand_state);
 #elif defined(PARTICLE)
     return HAL_RNG_GetRandomNumber();
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+
+#if defined(__linux__)
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include <warpcore/warpcore.h>
+
+#include "rss.h"
+
+#if defined(__linux__) && !defined(ETH_RSS_HASH_TOP)
+#define ETH_RSS_HASH_TOP 1 ///< ethtool hfunc bit for Toeplitz (not in uapi.)
+#endif
+
+
+/// The Toeplitz key from the Microsoft RSS specification, which many NICs use
+/// by default.
+///
+const uint8_t rss_default_key[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa};
+
+
+/// Compute the Toeplitz hash of @p len bytes of @p data under @p key. For each
+/// set bit of @p data, the 32-bit window of @p key starting at the same bit
+/// position is XORed into the hash.
+///
+/// @param[in]  key      The hash key, at least four bytes longer than @p len.
+/// @param[in]  key_len  The length of @p key.
+/// @param[in]  data     The data to hash.
+/// @param[in]  len      The length of @p data.
+///
+/// @return     Toeplitz hash of @p data.
+///
+uint32_t rss_toeplitz(const uint8_t * const key,
+                      const uint32_t key_len,
+                      const uint8_t * const data,
+                      const uint32_t len)
+{
+    assure(key_len >= len + 4, "key too short");
+    uint32_t h = 0;
+    uint32_t win = (uint32_t)key[0] << 24 | (uint32_t)key[1] << 16 |
+                   (uint32_t)key[2] << 8 | key[3];
+    for (uint32_t i = 0; i < len; i++) {
+        const uint8_t next = key[i + 4];
+        for (uint8_t b = 0; b < 8; b++) {
+            if (data[i] & (0x80 >> b))
+                h ^= win;
+            win = win << 1 | ((next >> (7 - b)) & 1);
+        }
+    }
+    return h;
+}
+
+
+/// Compute the RSS hash that a NIC configured with @p rss calculates for a UDP
+/// packet from @p src to @p dst.
+///
+/// @param[in]  rss   An RSS configuration.
+/// @param[in]  src   Source address and port of the packet.
+/// @param[in]  dst   Destination address and port of the packet.
+///
+/// @return     RSS hash of the packet.
+///
+uint32_t rss_hash(const struct rss * const rss,
+                  const struct w_sockaddr * const src,
+                  const struct w_sockaddr * const dst)
+{
+    // the input is the source and destination address, followed by the
+    // source and destination port, all in network byte order
+    uint8_t in[2 * IP6_LEN + 2 * sizeof(uint16_t)];
+    const uint8_t alen = af_len(src->addr.af);
+    uint32_t len = 2 * alen;
+    if (src->addr.af == AF_INET) {
+        memcpy(in, &src->addr.ip4, alen);
+        memcpy(&in[alen], &dst->addr.ip4, alen);
+    } else {
+        memcpy(in, src->addr.ip6, alen);
+        memcpy(&in[alen], dst->addr.ip6, alen);
+    }
+
+    if (src->addr.af == AF_INET ? rss->ports4 : rss->ports6) {
+        memcpy(&in[len], &src->port, sizeof(src->port));
+        memcpy(&in[len + sizeof(src->port)], &dst->port, sizeof(dst->port));
+        len += 2 * sizeof(uint16_t);
+    }
+
+    return rss_toeplitz(rss->key, rss->key_len, in, len);
+}
+
+
+/// Return the RX ring that a NIC configured with @p rss steers a UDP packet
+/// from @p src to @p dst to.
+///
+/// @param[in]  rss   An RSS configuration.
+/// @param[in]  src   Source address and port of the packet.
+/// @param[in]  dst   Destination address and port of the packet.
+///
+/// @return     RX ring index.
+///
+uint16_t rss_ring(const struct rss * const rss,
+                  const struct w_sockaddr * const src,
+                  const struct w_sockaddr * const dst)
+{
+    return rss->indir[rss_hash(rss, src, dst) % rss->indir_len];
+}
+
+
+#if defined(__linux__)
+/// Return whether the NIC of @p ifname hashes the UDP ports of packets of flow
+/// type @p flow_type, or @p dflt if this cannot be determined.
+///
+/// @param[in]  s          A socket for ethtool ioctls.
+/// @param      ifr        An ifreq for @p ifname.
+/// @param[in]  flow_type  UDP_V4_FLOW or UDP_V6_FLOW.
+/// @param[in]  dflt       Value to return if the query fails.
+///
+/// @return     Whether the UDP ports are part of the RSS hash.
+///
+static bool __attribute__((nonnull)) hashes_ports(const int s,
+                                                  struct ifreq * const ifr,
+                                                  const uint32_t flow_type,
+                                                  const bool dflt)
+{
+    struct ethtool_rxnfc nfc = {.cmd = ETHTOOL_GRXFH, .flow_type = flow_type};
+    ifr->ifr_data = (char *)&nfc;
+    if (ioctl(s, SIOCETHTOOL, ifr) == -1)
+        return dflt;
+    return (nfc.data & (RXH_L4_B_0_1 | RXH_L4_B_2_3)) ==
+           (RXH_L4_B_0_1 | RXH_L4_B_2_3);
+}
+#endif
+
+
+/// Initialize @p rss with the RSS configuration of interface @p ifname. Where
+/// it cannot be obtained from the NIC, assume the defaults most NICs use: the
+/// key from the Microsoft RSS specification, a four-tuple hash, and an
+/// indirection table of #RSS_INDIR_LEN entries that spreads the hash values
+/// round-robin over the @p nrings RX rings.
+///
+/// @param[out] rss     The RSS configuration to initialize.
+/// @param[in]  ifname  The interface name.
+/// @param[in]  nrings  The number of RX rings of @p ifname.
+///
+void rss_init(struct rss * const rss,
+              const char * const ifname
+#if !defined(__linux__)
+              __attribute__((unused))
+#endif
+              ,
+              const uint32_t nrings)
+{
+    memcpy(rss->key, rss_default_key, sizeof(rss_default_key));
+    rss->key_len = sizeof(rss_default_key);
+    rss->indir_len = RSS_INDIR_LEN;
+    for (uint32_t i = 0; i < rss->indir_len; i++)
+        rss->indir[i] = (uint16_t)(i % MAX(1, nrings));
+    rss->ports4 = rss->ports6 = true;
+
+#if defined(__linux__)
+    const int s = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ensure(s >= 0, "%s socket", ifname);
+    struct ifreq ifr = {0};
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ);
+    ifr.ifr_name[IFNAMSIZ - 1] = 0;
+
+    rss->ports4 = hashes_ports(s, &ifr, UDP_V4_FLOW, rss->ports4);
+    rss->ports6 = hashes_ports(s, &ifr, UDP_V6_FLOW, rss->ports6);
+
+    // ask for the sizes of the key and indirection table first
+    struct ethtool_rxfh sz = {.cmd = ETHTOOL_GRSSH};
+    ifr.ifr_data = (char *)&sz;
+    if (ioctl(s, SIOCETHTOOL, &ifr) == -1 || sz.key_size > RSS_KEY_LEN_MAX ||
+        sz.indir_size > RSS_INDIR_LEN_MAX) {
+        warn(NTE, "%s: cannot get RSS config, assuming defaults", ifname);
+        goto done;
+    }
+
+    struct ethtool_rxfh * const rxfh =
+        calloc(1, sizeof(*rxfh) + sz.indir_size * sizeof(uint32_t) +
+                      sz.key_size);
+    ensure(rxfh, "could not calloc");
+    rxfh->cmd = ETHTOOL_GRSSH;
+    rxfh->indir_size = sz.indir_size;
+    rxfh->key_size = sz.key_size;
+    ifr.ifr_data = (char *)rxfh;
+    if (ioctl(s, SIOCETHTOOL, &ifr) == -1)
+        warn(NTE, "%s: cannot get RSS config, assuming defaults", ifname);
+    else {
+        if (rxfh->hfunc && (rxfh->hfunc & ETH_RSS_HASH_TOP) == 0)
+            warn(WRN, "%s: RSS hash function is not Toeplitz", ifname);
+        if (rxfh->indir_size) {
+            rss->indir_len = rxfh->indir_size;
+            for (uint32_t i = 0; i < rss->indir_len; i++)
+                rss->indir[i] = (uint16_t)rxfh->rss_config[i];
+        }
+        if (rxfh->key_size) {
+            rss->key_len = rxfh->key_size;
+            memcpy(rss->key, &rxfh->rss_config[rxfh->indir_size],
+                   rss->key_len);
+        }
+    }
+    free(rxfh);
+
+done:
+    close(s);
+#endif
+
+    warn(INF, "%s: RSS over %u-entry table, %u-byte key, ports %shashed",
+         ifname, rss->indir_len, rss->key_len,
+         rss->ports4 && rss->ports6 ? "" : "not always ");
+}
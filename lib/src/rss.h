@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <warpcore/warpcore.h>
+
+
+#define RSS_KEY_LEN_MAX 64    ///< Longest RSS hash key supported.
+#define RSS_INDIR_LEN_MAX 512 ///< Largest RSS indirection table supported.
+#define RSS_INDIR_LEN 128     ///< Size of the default indirection table.
+
+
+/// Receive-side scaling (RSS) configuration of an interface, i.e., how its NIC
+/// spreads received packets over its RX rings: the Toeplitz hash of the
+/// addresses (and ports) of a packet, under @p key, indexes @p indir, which
+/// holds the ring the packet is steered to.
+///
+struct rss {
+    uint8_t key[RSS_KEY_LEN_MAX];      ///< Toeplitz hash key.
+    uint16_t indir[RSS_INDIR_LEN_MAX]; ///< Indirection table.
+    uint32_t key_len;                  ///< Length of @p key.
+    uint32_t indir_len;                ///< Number of entries in @p indir.
+    bool ports4; ///< Whether UDP ports are hashed for IPv4 packets.
+    bool ports6; ///< Whether UDP ports are hashed for IPv6 packets.
+    /// @cond
+    uint8_t _unused[2]; ///< @internal Padding.
+                        /// @endcond
+};
+
+
+extern const uint8_t rss_default_key[40];
+
+extern uint32_t __attribute__((nonnull))
+rss_toeplitz(const uint8_t * const key,
+             const uint32_t key_len,
+             const uint8_t * const data,
+             const uint32_t len);
+
+extern uint32_t __attribute__((nonnull))
+rss_hash(const struct rss * const rss,
+         const struct w_sockaddr * const src,
+         const struct w_sockaddr * const dst);
+
+extern uint16_t __attribute__((nonnull))
+rss_ring(const struct rss * const rss,
+         const struct w_sockaddr * const src,
+         const struct w_sockaddr * const dst);
+
+extern void __attribute__((nonnull)) rss_init(struct rss * const rss,
+                                              const char * const ifname,
+                                              const uint32_t nrings);
@@ -28,7 +28,9 @@
 #include <warpcore/warpcore.h>
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 #include <sys/socket.h>
@@ -58,12 +60,66 @@
 #endif
 
 
-// Receive a UDP packet.
+/// Check the UDP checksum of the IP packet starting at @p ip.
+///
+/// @param      ip    The IP header.
+/// @param      udp   The UDP header.
+/// @param[in]  len   Length of the IP header plus the UDP datagram.
+///
+/// @return     Whether the checksum is valid (or absent).
+///
+static inline bool __attribute__((always_inline, nonnull))
+cksum_ok(const uint8_t * const ip,
+         const struct udp_hdr * const udp,
+         const uint16_t len)
+{
+    if (unlikely(udp->cksum == 0) || likely(payload_cksum(ip, len) == 0))
+        return true;
+    warn(WRN, "invalid UDP checksum, received 0x%04x", bswap16(udp->cksum));
+    return false;
+}
+
+
+/// Check the UDP checksum of a received UDP packet that udp_rx() has already
+/// placed into a w_sock without doing so.
+///
+/// @param      buf   Ethernet frame containing the UDP packet.
+///
+/// @return     Whether the checksum is valid (or absent).
+///
+bool
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    udp_cksum_ok(uint8_t * const buf)
+{
+    const uint8_t * const ip = eth_data(buf);
+    uint16_t ip_hdr_len;
+    uint16_t ip_plen;
+
+    if (ip_v(*ip) == 4) {
+        const struct ip4_hdr * ip4 = (const void *)ip;
+        ip_hdr_len = ip4_hl(ip4->vhl);
+        ip_plen = bswap16(ip4->len) - ip_hdr_len;
+    } else {
+        const struct ip6_hdr * ip6 = (const void *)ip;
+        ip_hdr_len = sizeof(*ip6);
+        ip_plen = bswap16(ip6->len);
+    }
+
+    const struct udp_hdr * const udp = (const void *)(ip + ip_hdr_len);
+    return cksum_ok(ip, udp, MIN(bswap16(udp->len), ip_plen) + ip_hdr_len);
+}
+
 
 /// Receive a UDP packet. Validates the UDP checksum and appends the payload
 /// data to the corresponding w_sock. Also makes the receive timestamp and IPv4
 /// flags available, via w_iov::ts and w_iov::flags, respectively.
 ///
+/// The packet is demultiplexed on its headers alone. If the w_sock it belongs
+/// to has w_sockopt::enable_lazy_udp_checksums set, the payload is not touched
+/// here and checksum validation is left to w_iov_verify().
+///
 /// The Ethernet frame to operate on is in the current netmap lot of the
 /// indicated RX ring.
 ///
@@ -81,43 +137,36 @@ bool
            struct netmap_slot * const s,
            uint8_t * const buf)
 {
-    // grab an unused iov for the data in this packet
-    //
-    // TODO: w_alloc_iov() does some (in this case) unneeded initialization;
-    // determine if that overhead is a problem
-    struct w_iov * const i = w_alloc_iov_base(w);
-    if (unlikely(i == 0)) {
-        warn(CRT, "no more bufs; UDP packet RX failed");
-        return false;
-    }
-
     const uint8_t * const ip = eth_data(buf);
     const uint8_t v = ip_v(*ip);
     uint16_t ip_hdr_len;
     struct udp_hdr * udp;
     uint16_t ip_plen;
+    uint8_t tos;
+    uint8_t ttl;
     struct w_sockaddr local;
+    struct w_sockaddr remote;
 
     if (v == 4) {
         const struct ip4_hdr * ip4 = (const void *)ip;
         ip_hdr_len = ip4_hl(ip4->vhl);
         ip_plen = bswap16(ip4->len) - ip_hdr_len;
         udp = (void *)ip4_data(buf);
-        local.addr.af = i->wv_af = AF_INET;
-        i->wv_ip4 = ip4->src;
+        local.addr.af = remote.addr.af = AF_INET;
+        remote.addr.ip4 = ip4->src;
         local.addr.ip4 = ip4->dst;
-        i->flags = ip4->tos;
-        i->ttl = ip4->ttl;
+        tos = ip4->tos;
+        ttl = ip4->ttl;
     } else {
         const struct ip6_hdr * ip6 = (const void *)ip;
         ip_hdr_len = sizeof(*ip6);
         ip_plen = bswap16(ip6->len);
         udp = (void *)ip6_data(buf);
-        local.addr.af = i->wv_af = AF_INET6;
-        memcpy(i->wv_ip6, ip6->src, sizeof(i->wv_ip6));
+        local.addr.af = remote.addr.af = AF_INET6;
+        memcpy(remote.addr.ip6, ip6->src, sizeof(remote.addr.ip6));
         memcpy(local.addr.ip6, ip6->dst, sizeof(local.addr.ip6));
-        i->flags = ip6_tos(ip6->vtcecnfl);
-        i->ttl = ip6->hlim;
+        tos = ip6_tos(ip6->vtcecnfl);
+        ttl = ip6->hlim;
     }
 
     if (unlikely(ip_plen < sizeof(*udp))) {
@@ -126,35 +175,65 @@ bool
     }
 
     const uint16_t udp_len = MIN(bswap16(udp->len), ip_plen);
-    i->len = udp_len - sizeof(*udp);
     udp_log(udp);
 
-    if (likely(udp->cksum)) {
-        // validate the checksum
-        if (unlikely(payload_cksum(ip, udp_len + ip_hdr_len) != 0)) {
-            warn(WRN, "invalid UDP checksum, received 0x%04x",
-                 bswap16(udp->cksum));
-            return false;
-        }
-    }
-
-    i->wv_port = udp->sport;
+    remote.port = udp->sport;
     local.port = udp->dport;
-    struct w_sock * ws = w_get_sock(w, &local, &i->saddr);
-    if (unlikely(ws == 0)) {
-        // no socket connected, check for bound-only socket
-        ws = w_get_sock(w, &local, 0);
+
+    // packets in a burst tend to belong to the same flow, so check whether
+    // this one goes to the same w_sock as the last one before hashing
+    struct w_backend * const b = w->b;
+    struct w_sock * ws = b->rx_sock;
+    if (unlikely(ws == 0 ||
+                 w_sockaddr_cmp(&remote, &b->rx_tup.remote) == false ||
+                 w_sockaddr_cmp(&local, &b->rx_tup.local) == false)) {
+        // find a socket connected to this four-tuple, or else one bound to
+        // the local address and port
+        ws = flowtab_demux(&b->sock, &local, &remote);
         if (unlikely(ws == 0)) {
+            // a w_sock of another per-ring engine may own the flow, in which
+            // case it is not unreachable, just steered to the wrong ring
+            if (group_demux(w, &local, &remote)) {
+                warn(DBG, "UDP packet for a w_sock of another ring; ignoring");
+                return false;
+            }
             // nobody bound to this port locally
+            if (unlikely(cksum_ok(ip, udp, udp_len + ip_hdr_len) == false))
+                return false;
             // send an ICMP unreachable reply, if this was not a broadcast
-            if (v == 4 && is_my_ip4(w, i->wv_ip4, false) != UINT16_MAX)
+            if (v == 4 && is_my_ip4(w, remote.addr.ip4, false) != UINT16_MAX)
                 icmp4_tx(w, ICMP4_TYPE_UNREACH, ICMP4_UNREACH_PORT, buf);
-            else if (v == 6 && is_my_ip6(w, i->wv_ip6, false) != UINT16_MAX)
+            else if (v == 6 &&
+                     is_my_ip6(w, remote.addr.ip6, false) != UINT16_MAX)
                 icmp6_tx(w, ICMP6_TYPE_UNREACH, ICMP6_UNREACH_PORT, buf);
             return false;
         }
+        b->rx_sock = ws;
+        b->rx_tup.local = local;
+        b->rx_tup.remote = remote;
     }
 
+    const bool lazy = ws->opt.enable_lazy_udp_checksums;
+    if (likely(lazy == false) &&
+        unlikely(cksum_ok(ip, udp, udp_len + ip_hdr_len) == false))
+        return false;
+
+    // grab an unused iov for the data in this packet
+    //
+    // TODO: w_alloc_iov() does some (in this case) unneeded initialization;
+    // determine if that overhead is a problem
+    struct w_iov * const i = w_alloc_iov_base(w);
+    if (unlikely(i == 0)) {
+        warn(CRT, "no more bufs; UDP packet RX failed");
+        return false;
+    }
+
+    *i->saddr = remote;
+    i->flags = tos;
+    i->ttl = ttl;
+    i->len = udp_len - sizeof(*udp);
+    i->__unverified = lazy && udp->cksum;
+
 #if 0
     warn(DBG, "swapping rx slot idx %d and spare idx %u", s->buf_idx, i->idx);
 #endif
@@ -172,14 +251,121 @@ bool
 
     // append the iov to the socket
     sq_insert_tail(&ws->iv, i, next);
+    mark_ready(ws);
     return true;
 }
 
 
+/// Build (or rebuild) the template header of the connected w_sock @p s, and
+/// the partial checksums over its constant fields.
+///
+/// @param      s     A connected w_sock.
+///
+void
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    udp_mk_hdr(struct w_sock * const s)
+{
+    if (s->__hdr == 0)
+        ensure((s->__hdr = calloc(1, sizeof(*s->__hdr))) != 0,
+               "cannot alloc w_hdr");
+    struct w_hdr * const h = s->__hdr;
+    memset(h->buf, 0, sizeof(h->buf));
+
+    // build the headers of an empty packet
+    struct w_sockaddr dst = s->ws_rem;
+    struct w_iov v = {
+        .base = h->buf, .w = s->w, .saddr = &dst, .len = sizeof(struct udp_hdr)};
+    struct udp_hdr * udp;
+    if (s->ws_af == AF_INET) {
+        mk_ip4_hdr(&v, s);
+        struct ip4_hdr * const ip = (void *)eth_data(h->buf);
+        ip->len = ip->id = ip->cksum = 0;
+        h->ip_sum = ip_cksum_partial(&ip->off, sizeof(*ip) -
+                                                   offsetof(struct ip4_hdr, off));
+        h->udp_sum = ip_cksum_partial(&ip->src, 2 * sizeof(ip->src));
+        udp = (void *)(ip + 1);
+    } else {
+        mk_ip6_hdr(&v, s);
+        struct ip6_hdr * const ip = (void *)eth_data(h->buf);
+        ip->len = 0;
+        h->udp_sum = ip_cksum_partial(ip->src, 2 * sizeof(ip->src));
+        udp = (void *)(ip + 1);
+    }
+    mk_eth_hdr(s, &v);
+
+    udp->sport = s->ws_lport;
+    udp->dport = s->ws_rport;
+    h->udp_sum += ip_cksum_partial(udp, sizeof(udp->sport) + sizeof(udp->dport));
+    h->udp_sum += ip_cksum_partial((const uint8_t[]){0, IP_P_UDP}, 2);
+    h->len = (uint16_t)((uint8_t *)(udp + 1) - h->buf);
+}
+
+
+/// Fill in the headers of w_iov @p v for the connected w_sock @p s, by copying
+/// the template header and patching the length, TOS, IPv4 ID and checksum
+/// fields.
+///
+/// @param      s     The w_sock to transmit over.
+/// @param      v     The w_iov to transmit, with the UDP header included in
+///                   w_iov::len.
+///
+/// @return     Pointer to the UDP header in @p v.
+///
+static inline struct udp_hdr * __attribute__((always_inline, nonnull))
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+__attribute__((no_sanitize("alignment")))
+#endif
+udp_tmpl(const struct w_sock * const s, struct w_iov * const v)
+{
+    const struct w_hdr * const h = s->__hdr;
+    memcpy(v->base, h->buf, h->len);
+
+    // if there is no per-packet ECN marking, apply default
+    const uint8_t tos = (v->flags & ECN_MASK) == 0 && s->opt.enable_ecn
+                            ? v->flags | ECN_ECT0
+                            : v->flags;
+    const uint16_t udp_len = v->len;
+    if (s->ws_af == AF_INET) {
+        struct ip4_hdr * const ip = (void *)eth_data(v->base);
+        if (unlikely(v->flags))
+            ip->tos = tos;
+        v->len += sizeof(*ip);
+        ip->len = bswap16(v->len);
+        // no need to do bswap16() for random value
+        ip->id = (uint16_t)w_rand_uniform32(UINT16_MAX);
+        uint16_t hw[3];
+        memcpy(hw, ip, sizeof(hw));
+        ip->cksum = ip_cksum_fold(h->ip_sum + hw[0] + hw[1] + hw[2]);
+    } else {
+        struct ip6_hdr * const ip = (void *)eth_data(v->base);
+        if (unlikely(v->flags))
+            ip->vtcecnfl =
+                (6 << 4) | (uint32_t)((tos & 0x0f) << 12 | (tos & 0xf0) >> 4);
+        ip->len = bswap16(udp_len);
+        v->len += sizeof(*ip);
+    }
+
+    struct udp_hdr * const udp = (void *)(v->base + h->len - sizeof(*udp));
+    udp->len = bswap16(udp_len);
+    if (likely(s->opt.enable_udp_zero_checksums == false)) {
+        // the length is in the pseudo-header and the UDP header
+        const uint16_t c = ip_cksum_fold(
+            h->udp_sum + 2 * (uint32_t)udp->len +
+            ip_cksum_partial(udp + 1, udp_len - sizeof(*udp)));
+        // a computed checksum of zero is transmitted as all ones
+        udp->cksum = c ? c : 0xffff;
+    }
+    return udp;
+}
+
+
 /// Sends a payload contained in a w_sock::ov via UDP. For a connected w_sock,
-/// prepends the template header from w_sock::hdr, computes the UDP length and
-/// checksum, and hands the packet off to ip_tx(). For a disconnected w_sock,
-/// uses the destination IP and port information in the w_iov for TX.
+/// prepends the template header built by udp_mk_hdr(), patches the lengths
+/// and checksums, and hands the packet off to eth_tx(). For a disconnected
+/// w_sock, builds the headers from scratch, using the destination IP and port
+/// information in the w_iov.
 ///
 /// @param      s     The w_sock to transmit over.
 /// @param      v     The w_iov to transmit.
@@ -191,6 +377,14 @@ bool udp_tx(const struct w_sock * const s, struct w_iov * const v)
     const uint16_t vlen = v->len;
     v->len += sizeof(struct udp_hdr);
 
+    if (likely(s->__hdr)) {
+        const struct udp_hdr * const udp = udp_tmpl(s, v);
+        udp_log(udp);
+        const bool ret = eth_tx(v);
+        v->len = vlen;
+        return ret;
+    }
+
     uint16_t ip_hdr_len;
     struct udp_hdr * udp;
     if (s->ws_af == AF_INET) {
@@ -46,6 +46,25 @@ struct udp_hdr {
 } __attribute__((aligned(1)));
 
 
+/// Template of the Ethernet, IP and UDP headers of a connected w_sock, which
+/// udp_tx() copies into each packet and then patches.
+///
+struct w_hdr {
+    /// The headers, with zero IP ID, lengths and checksums. Large enough for
+    /// Ethernet + IPv6 + UDP.
+    uint8_t buf[14 + 40 + sizeof(struct udp_hdr)];
+    uint16_t len; ///< Length of the headers in @p buf.
+    /// Sum of the IPv4 header words after the ID field (not used for IPv6.)
+    uint32_t ip_sum;
+    /// Sum of the UDP pseudo-header addresses and protocol, and of the ports.
+    uint32_t udp_sum;
+};
+
+
+extern void __attribute__((nonnull)) udp_mk_hdr(struct w_sock * const s);
+
+extern bool __attribute__((nonnull)) udp_cksum_ok(uint8_t * const buf);
+
 extern bool __attribute__((nonnull)) udp_rx(struct w_engine * const w,
                                             struct netmap_slot * const s,
                                             uint8_t * const buf);
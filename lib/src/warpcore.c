@@ -55,14 +55,22 @@
 #include "ip6.h"
 #include "neighbor.h"
 
+#ifdef WITH_NETMAP
+#include "udp.h"
+#endif
+
 
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
 #include <net/if.h>
+#include <pthread.h>
 
 /// A global list of netmap engines that have been initialized for different
 /// interfaces.
 ///
 static sl_head(w_engines, w_engine) engines = sl_head_initializer(engines);
+
+/// Protects @p engines, since threads may each initialize their own engine.
+static pthread_mutex_t engines_lock = PTHREAD_MUTEX_INITIALIZER;
 #else
 #define strerror(...) ""
 #endif
@@ -92,8 +100,338 @@ dump_bufs(const char * const label, const struct w_iov_sq * const q)
 #endif
 
 
+/// Number of w_iovs a per-thread magazine holds.
+#define MAG_SIZE 64
+
+/// Number of engines a thread can cache w_iovs for. Further engines used by
+/// the same thread allocate from and free to their depots directly.
+#define MAG_ENGINES 4
+
+/// A per-thread cache of free w_iovs of an engine, in the style of Bonwick's
+/// magazines. Allocation and free operate LIFO on the @p cur magazine, so
+/// recently freed (cache-warm) w_iovs are reused first; @p prev is either
+/// full or empty, and buffers only move to or from the engine's depot
+/// (w_engine::iov) MAG_SIZE at a time.
+///
+struct w_mag {
+    struct w_engine * w;  ///< Engine whose w_iovs are cached, or zero.
+    uint64_t gen;         ///< The w_engine::__gen of @p w.
+    struct w_iov_sq cur;  ///< Magazine alloc and free operate on.
+    struct w_iov_sq prev; ///< Previously used magazine.
+};
+
+static _Thread_local struct w_mag mags[MAG_ENGINES]
+    __attribute__((tls_model("initial-exec")));
+
+/// Source of w_engine::__gen, which tells engines apart that w_init() happens
+/// to allocate at the address of an earlier one.
+static uint64_t engine_gen;
+
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+/// Key whose destructor returns the w_iovs of exiting threads; see mags_exit().
+static pthread_key_t mags_key;
+
+/// Makes sure @p mags_key is only created once.
+static pthread_once_t mags_once = PTHREAD_ONCE_INIT;
+#endif
+
+
+/// Move the w_iovs in @p q to the front of @p head, so they are reused first.
+///
+/// @param      head  Tail queue to prepend to.
+/// @param      q     Tail queue to prepend.
+///
+static inline void __attribute__((nonnull, no_instrument_function))
+prepend(struct w_iov_sq * const head, struct w_iov_sq * const q)
+{
+    if (likely(sq_empty(head) == false)) {
+        *q->stqh_last = sq_first(head);
+        sq_first(head) = sq_first(q);
+        sq_len(head) += sq_len(q);
+        sq_init(q);
+    } else
+        sq_concat(head, q);
+}
+
+
+static void __attribute__((no_instrument_function, nonnull))
+reinit_iov(struct w_iov * const v)
+{
+    v->buf = v->base;
+    v->len = max_buf_len(v->w);
+    v->flags = v->ttl = v->__unverified = 0;
+    sq_next(v, next) = 0;
+}
+
+
+/// Move up to @p n w_iovs from the front of the depot of engine @p w to the tail
+/// of @p q, detaching them under one hold of the depot lock.
+///
+/// @param      w     Backend engine.
+/// @param      q     Tail queue to append to.
+/// @param[in]  n     Maximum number of w_iovs to move.
+///
+/// @return     Number of w_iovs moved, which is zero if the depot is empty.
+///
+static uint_t __attribute__((nonnull))
+depot_get(struct w_engine * const w, struct w_iov_sq * const q, const uint_t n)
+{
+    depot_lock(w);
+    struct w_iov * const first = sq_first(&w->iov);
+    if (unlikely(first == 0)) {
+        depot_unlock(w);
+        return 0;
+    }
+    struct w_iov * last = first;
+    uint_t got = 1;
+    while (likely(got < n) && sq_next(last, next)) {
+        last = sq_next(last, next);
+        got++;
+    }
+    if ((sq_first(&w->iov) = sq_next(last, next)) == 0)
+        w->iov.stqh_last = &sq_first(&w->iov);
+    sq_len(&w->iov) -= got;
+    depot_count(w, first, got, false);
+    depot_unlock(w);
+
+    sq_next(last, next) = 0;
+    *q->stqh_last = first;
+    q->stqh_last = &sq_next(last, next);
+    sq_len(q) += got;
+    return got;
+}
+
+
+/// Move the w_iovs in @p q to the front of the depot of engine @p w.
+///
+/// @param      w     Backend engine.
+/// @param      q     Tail queue of w_iovs to move.
+///
+static inline void __attribute__((nonnull))
+depot_put(struct w_engine * const w, struct w_iov_sq * const q)
+{
+    depot_lock(w);
+    depot_count(w, sq_first(q), sq_len(q), true);
+    prepend(&w->iov, q);
+    depot_unlock(w);
+}
+
+
+/// Move the w_iovs in the magazines of slot @p m to the depot of its engine,
+/// and free the slot.
+///
+/// @param      m     Magazines of the calling thread.
+///
+static void __attribute__((nonnull)) mag_flush(struct w_mag * const m)
+{
+    struct w_engine * const w = m->w;
+    depot_lock(w);
+    depot_count(w, sq_first(&m->cur), sq_len(&m->cur), true);
+    depot_count(w, sq_first(&m->prev), sq_len(&m->prev), true);
+    sq_concat(&w->iov, &m->cur);
+    sq_concat(&w->iov, &m->prev);
+    depot_unlock(w);
+    m->w = 0;
+}
+
+
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+/// Thread-exit destructor of @p mags_key. Returns the w_iovs that the exiting
+/// thread still caches to the depots of engines that have not started to shut
+/// down (w_cleanup() marks them under @p engines_lock.)
+///
+/// @param      arg   The @p mags array of the exiting thread.
+///
+static void mags_exit(void * const arg)
+{
+    struct w_mag * const tm = arg;
+    ensure(pthread_mutex_lock(&engines_lock) == 0, "pthread_mutex_lock");
+    for (struct w_mag * m = tm; m < tm + MAG_ENGINES; m++) {
+        if (m->w == 0)
+            continue;
+        struct w_engine * e;
+        sl_foreach (e, &engines, next)
+            if (e == m->w && e->__gen == m->gen && e->__closing == false) {
+                mag_flush(m);
+                break;
+            }
+        m->w = 0;
+    }
+    ensure(pthread_mutex_unlock(&engines_lock) == 0, "pthread_mutex_unlock");
+}
+
+
+static void mags_key_create(void)
+{
+    ensure(pthread_key_create(&mags_key, mags_exit) == 0,
+           "pthread_key_create");
+}
+#endif
+
+
+/// Return the calling thread's magazines for engine @p w.
+///
+/// @param      w     Backend engine.
+///
+/// @return     Magazines for @p w, or zero if the thread has no free slot or
+///             @p w is being shut down.
+///
+static inline struct w_mag * __attribute__((nonnull, no_instrument_function))
+mag_of(struct w_engine * const w)
+{
+    // w_cleanup() frees the buffers, so they must not be cached from then on
+    if (unlikely(w->__closing))
+        return 0;
+    for (struct w_mag * m = mags; m < mags + MAG_ENGINES; m++) {
+        if (likely(m->w == w && m->gen == w->__gen))
+            return m;
+        // a slot of an engine that was cleaned up and whose address w_init()
+        // reused still holds the freed w_iovs of the old one; drop them
+        if (m->w == 0 || m->w == w) {
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+            // have the w_iovs returned when the thread exits
+            ensure(pthread_once(&mags_once, mags_key_create) == 0,
+                   "pthread_once");
+            ensure(pthread_setspecific(mags_key, mags) == 0,
+                   "pthread_setspecific");
+#endif
+            m->w = w;
+            m->gen = w->__gen;
+            sq_init(&m->cur);
+            sq_init(&m->prev);
+            return m;
+        }
+    }
+    return 0;
+}
+
+
+/// Slow path of w_alloc_iov_base(), for when the current magazine @p m is
+/// empty. Swaps in the previous magazine if it is full, or else refills the
+/// current one with up to MAG_SIZE w_iovs from the depot of engine @p w
+/// (growing the pool if the depot is empty.) Without magazines, allocates
+/// directly from the depot.
+///
+/// @param      w     Backend engine.
+/// @param      m     Magazines of the calling thread for @p w, or zero.
+///
+/// @return     Spare w_iov, or zero if the pool is exhausted.
+///
+static struct w_iov * __attribute__((nonnull(1), noinline))
+mag_get_slow(struct w_engine * const w, struct w_mag * const m)
+{
+    struct w_iov_sq one = w_iov_sq_initializer(one);
+    struct w_iov_sq * const q = likely(m) ? &m->cur : &one;
+    if (likely(m) && sq_empty(&m->prev) == false)
+        sq_swap(&m->cur, &m->prev, w_iov);
+    else if (unlikely(depot_get(w, q, m ? MAG_SIZE : 1) == 0)) {
+        // growing maps and prefaults memory, so don't hold the lock for it
+        if (backend_grow(w) == false ||
+            // other threads may have taken the new buffers already
+            unlikely(depot_get(w, q, m ? MAG_SIZE : 1) == 0))
+            return 0;
+    }
+
+    struct w_iov * const v = sq_first(q);
+    sq_remove_head(q, next);
+    return v;
+}
+
+
+/// Return w_iov @p v to the calling thread's magazines for engine @p w. If
+/// both magazines are full, the previous one is spilled into the depot.
+///
+/// @param      w     Backend engine.
+/// @param      v     The w_iov to free.
+///
+static inline void __attribute__((nonnull, no_instrument_function))
+mag_put(struct w_engine * const w, struct w_iov * const v)
+{
+    struct w_mag * const m = mag_of(w);
+    if (unlikely(m == 0)) {
+        depot_lock(w);
+        sq_insert_head(&w->iov, v, next);
+        depot_count(w, v, 1, true);
+        depot_unlock(w);
+        return;
+    }
+
+    if (unlikely(sq_len(&m->cur) == MAG_SIZE)) {
+        if (sq_empty(&m->prev) == false)
+            depot_put(w, &m->prev);
+        sq_swap(&m->cur, &m->prev, w_iov);
+    }
+    sq_insert_head(&m->cur, v, next);
+}
+
+
+/// Return the w_iovs in @p q to the calling thread's magazines for engine @p w,
+/// in constant time. If they don't fit, the current magazine is rotated like in
+/// mag_put(), and tail queues larger than a magazine go to the depot.
+///
+/// @param      w     Backend engine.
+/// @param      q     Tail queue of w_iovs to free.
+///
+static inline void __attribute__((nonnull))
+mag_put_sq(struct w_engine * const w, struct w_iov_sq * const q)
+{
+    struct w_mag * const m = mag_of(w);
+    if (likely(m) && sq_len(&m->cur) + sq_len(q) > MAG_SIZE) {
+        if (sq_empty(&m->prev) == false)
+            depot_put(w, &m->prev);
+        sq_swap(&m->cur, &m->prev, w_iov);
+    }
+
+    if (unlikely(m == 0) || sq_len(q) > MAG_SIZE) {
+        depot_put(w, q);
+        return;
+    }
+    prepend(&m->cur, q);
+}
+
+
+/// Return the w_iovs that the calling thread caches for engine @p w to the
+/// engine's shared pool. Threads that have used @p w must call this before it
+/// is passed to w_cleanup() by another thread. (Threads that exit return their
+/// w_iovs automatically.)
+///
+/// @param      w     Backend engine.
+///
+void w_release_bufs(struct w_engine * const w)
+{
+    for (struct w_mag * m = mags; m < mags + MAG_ENGINES; m++)
+        if (m->w == w && m->gen == w->__gen) {
+            mag_flush(m);
+            return;
+        }
+}
+
+
+/// Leave @p hdr_space plus @p off bytes of header space at the front of freshly
+/// allocated w_iov @p v, and limit its length to @p len, if that is non-zero.
+///
+/// @param      v          The w_iov.
+/// @param[in]  hdr_space  Space needed for the headers of the address family.
+/// @param[in]  len        The length of @p buf.
+/// @param[in]  off        Additional offset into the buffer.
+///
+static inline void __attribute__((nonnull, always_inline))
+alloc_off(struct w_iov * const v,
+          const uint16_t hdr_space,
+          const uint16_t len,
+          const uint16_t off)
+{
+    v->buf += off + hdr_space;
+    v->len = len ? len : v->len - (off + hdr_space);
+#ifdef DEBUG_BUFFERS
+    warn(DBG, "alloc w_iov off %u len %u", (uint16_t)(v->buf - v->base),
+         v->len);
+#endif
+}
+
+
 /// Return a spare w_iov from the pool of the given warpcore engine. Needs to be
-/// returned to w->iov via sq_insert_head() or sq_concat().
+/// returned via w_free_iov() or w_free().
 ///
 /// @param      w     Backend engine.
 /// @param[in]  af    Address family to allocate packet buffers.
@@ -117,15 +455,8 @@ w_alloc_iov(struct w_engine * const w,
 #endif
     assure(af == AF_INET || af == AF_INET6, "unknown address family");
     struct w_iov * const v = w_alloc_iov_base(w);
-    if (likely(v)) {
-        const uint16_t hdr_space = iov_off(w, af);
-        v->buf += off + hdr_space;
-        v->len = len ? len : v->len - (off + hdr_space);
-#ifdef DEBUG_BUFFERS
-        warn(DBG, "alloc w_iov off %u len %u", (uint16_t)(v->buf - v->base),
-             v->len);
-#endif
-    }
+    if (likely(v))
+        alloc_off(v, iov_off(w, af), len, off);
     dump_bufs(__func__, &w->iov);
     return v;
 }
@@ -208,7 +539,29 @@ void w_alloc_cnt(struct w_engine * const w,
     warn(DBG, "w_alloc_cnt count %" PRIu ", len %u, off %u", count, len, off);
     assure(sq_empty(q), "q not empty");
 #endif
-    for (uint_t needed = 0; likely(needed < count); needed++) {
+    uint_t needed = 0;
+    if (count > MAG_SIZE) {
+        // take large requests from the depot in one pass, rather than a
+        // magazine at a time
+        const uint16_t hdr_space = iov_off(w, af);
+        depot_lock(w);
+        struct w_iov * v = sq_first(&w->iov);
+        for (; v && likely(needed < count); needed++) {
+            struct w_iov * const n = sq_next(v, next);
+            depot_count(w, v, 1, false);
+            reinit_iov(v);
+            ASAN_UNPOISON_MEMORY_REGION(v->base, v->len);
+            alloc_off(v, hdr_space, len, off);
+            sq_insert_tail(q, v, next);
+            v = n;
+        }
+        if ((sq_first(&w->iov) = v) == 0)
+            w->iov.stqh_last = &sq_first(&w->iov);
+        sq_len(&w->iov) -= needed;
+        depot_unlock(w);
+    }
+
+    for (; likely(needed < count); needed++) {
         struct w_iov * const v = w_alloc_iov(w, af, len, off);
         if (unlikely(v == 0))
             return;
@@ -327,6 +680,9 @@ void w_close(struct w_sock * const s)
 {
     backend_close(s);
 
+    // free any data that was not read
+    w_free(&s->iv);
+
     // free the socket
     free(s);
 }
@@ -341,9 +697,21 @@ void w_close(struct w_sock * const s)
 void w_cleanup(struct w_engine * const w)
 {
     warn(NTE, "warpcore shutting down");
+    w_release_bufs(w);
+    // backend_cleanup() frees more w_iovs, which must go to the depot (and
+    // exiting threads must not return theirs once it has started)
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    ensure(pthread_mutex_lock(&engines_lock) == 0, "pthread_mutex_lock");
+    w->__closing = true;
+    ensure(pthread_mutex_unlock(&engines_lock) == 0, "pthread_mutex_unlock");
+#else
+    w->__closing = true;
+#endif
     backend_cleanup(w);
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    ensure(pthread_mutex_lock(&engines_lock) == 0, "pthread_mutex_lock");
     sl_remove(&engines, w, w_engine, next);
+    ensure(pthread_mutex_unlock(&engines_lock) == 0, "pthread_mutex_unlock");
 #endif
     free(w->b);
     free(w);
@@ -391,35 +759,73 @@ void ip6_config(struct w_ifaddr * const ia, const uint8_t * const mask)
 }
 
 
+#if !defined(PARTICLE) && !defined(RIOT_VERSION)
+/// Return whether a new engine with options @p opt may be initialized on the
+/// interface of the existing engine @p e.
+///
+/// @param[in]  e     Existing engine.
+/// @param[in]  opt   Engine options of the new engine. Can be zero.
+///
+/// @return     Whether the engines can share the interface.
+///
+static bool __attribute__((nonnull(1)))
+may_share(const struct w_engine * const e, const struct w_engopt * const opt)
+{
+    if (opt == 0)
+        return false;
+#ifdef WITH_NETMAP
+    // netmap engines own the rings they register, so they can only share the
+    // interface if each registers a different one
+    return opt->enable_one_ring && e->opt.enable_one_ring &&
+           opt->ring != e->opt.ring;
+#else
+    // engines that share ports via SO_REUSEPORT may share the interface
+    return opt->enable_reuseport && e->opt.enable_reuseport;
+#endif
+}
+#endif
+
+
 /// Initialize a warpcore engine on the given interface. Ethernet and IP
 /// source addresses and related information, such as the netmask, are taken
 /// from the active OS configuration of the interface. A default router,
 /// however, needs to be specified with @p rip, if communication over a WAN is
 /// desired. @p nbufs controls how many packet buffers the engine will attempt
-/// to allocate.
+/// to allocate initially; w_engopt::max_bufs lets the socket backend grow the
+/// pool beyond that on demand.
 ///
 /// @param[in]  ifname  The OS name of the interface (e.g., "eth0").
 /// @param[in]  rip     The default router to be used for non-local
 ///                     destinations. Can be zero.
 /// @param[in]  nbufs   Number of extra packet buffers to allocate.
+/// @param[in]  opt     Engine options. Can be zero.
 ///
 /// @return     Initialized warpcore engine.
 ///
 struct w_engine * w_init(const char * const ifname,
                          const uint32_t rip __attribute__((unused)),
-                         const uint_t nbufs)
+                         const uint_t nbufs,
+                         const struct w_engopt * const opt)
 {
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
+    // hold the lock until the new engine is on the list, so that concurrent
+    // w_init() calls cannot both pass the check below
+    ensure(pthread_mutex_lock(&engines_lock) == 0, "pthread_mutex_lock");
     struct w_engine * e;
     sl_foreach (e, &engines, next)
         if (strncmp(ifname, e->ifname, IFNAMSIZ) == 0 &&
-            e->is_loopback == false) {
+            e->is_loopback == false && may_share(e, opt) == false) {
+            ensure(pthread_mutex_unlock(&engines_lock) == 0,
+                   "pthread_mutex_unlock");
             warn(ERR, "can only have one warpcore engine active on %s", ifname);
             return 0;
         }
 #endif
 
+#ifdef FUZZING
+    // reseed, so each fuzzer run is reproducible
     w_init_rand();
+#endif
 
     // we mostly loop here because the link may be down
     uint16_t addr_cnt;
@@ -441,6 +847,9 @@ struct w_engine * w_init(const char * const ifname,
         w->ifname[sizeof(w->ifname) - 1] = 0;
     }
     sq_init(&w->iov);
+    w->__gen = __atomic_add_fetch(&engine_gen, 1, __ATOMIC_RELAXED);
+    if (opt)
+        w->opt = *opt;
 
     // backend-specific init
     w->b = calloc(1, sizeof(*w->b));
@@ -462,6 +871,7 @@ struct w_engine * w_init(const char * const ifname,
 #if !defined(PARTICLE) && !defined(RIOT_VERSION)
     // store the initialized engine in our global list
     sl_insert_head(&engines, w, next);
+    ensure(pthread_mutex_unlock(&engines_lock) == 0, "pthread_mutex_unlock");
 #endif
 
     warn(INF, "%s/%s (%s) %s using %" PRIu " %u-byte bufs on %s", warpcore_name,
@@ -471,6 +881,62 @@ struct w_engine * w_init(const char * const ifname,
 }
 
 
+/// Check/wait until any data has been received, or until a w_sock that was
+/// blocked on transmit has become writable.
+///
+/// With w_engopt::enable_adaptive_poll, a call that may block first busy-polls
+/// for up to twice the moving average of the interval between receptions
+/// (capped at w_engopt::spin_ns), and only blocks for the remainder of @p nsec
+/// if nothing arrived by then. When packets arrive too far apart for spinning
+/// to pay off, it blocks right away. Returns that are only due to a w_sock
+/// becoming writable do not count as receptions.
+///
+/// @param[in]  w     Backend engine.
+/// @param[in]  nsec  Timeout in nanoseconds. Pass zero for immediate return, -1
+///                   for infinite wait.
+///
+/// @return     Whether any data is ready for reading, or any w_sock has become
+///             writable.
+///
+bool w_nic_rx(struct w_engine * const w, const int64_t nsec)
+{
+    if (likely(w->opt.enable_adaptive_poll == false || nsec == 0))
+        return backend_nic_rx(w, nsec, 0);
+
+    const uint64_t max = w->opt.spin_ns ? w->opt.spin_ns : W_SPIN_NS;
+    uint64_t spin = w->__rx_gap <= max / 2 ? 2 * w->__rx_gap : 0;
+    if (nsec > 0 && spin > (uint64_t)nsec)
+        spin = (uint64_t)nsec;
+
+    const uint64_t start = w_now(CLOCK_MONOTONIC);
+    uint64_t now = start;
+    bool rcvd;
+    bool rx = backend_nic_rx(w, 0, &rcvd);
+    while (rx == false && now - start < spin) {
+        rx = backend_nic_rx(w, 0, &rcvd);
+        now = w_now(CLOCK_MONOTONIC);
+    }
+
+    if (rx == false) {
+        const int64_t left = nsec < 0 ? -1 : nsec - (int64_t)(now - start);
+        if (left == -1 || left > 0) {
+            rx = backend_nic_rx(w, left, &rcvd);
+            now = w_now(CLOCK_MONOTONIC);
+        }
+    }
+
+    if (rcvd) {
+        // track an EWMA (with gain 1/8) of the time between receptions
+        if (w->__rx_t) {
+            const uint64_t gap = now - w->__rx_t;
+            w->__rx_gap = w->__rx_gap ? (7 * w->__rx_gap + gap) / 8 : gap;
+        }
+        w->__rx_t = now;
+    }
+    return rx;
+}
+
+
 /// Return the maximum IP payload a given w_iov may have for the given IP
 /// address family. Basically, subtracts the header space and any offset
 /// specified when allocating the w_iov from the MTU.
@@ -507,8 +973,7 @@ void w_free(struct w_iov_sq * const q)
         ASAN_POISON_MEMORY_REGION(v->base, max_buf_len(w));
     }
 #endif
-    sq_concat(&w->iov, q);
-    dump_bufs(__func__, &w->iov);
+    mag_put_sq(w, q);
 }
 
 
@@ -525,10 +990,137 @@ void __attribute__((no_instrument_function)) w_free_iov(struct w_iov * const v)
     assure(sq_next(v, next) == 0,
            "idx %" PRIu32 " still linked to idx %" PRIu32, v->idx,
            sq_next(v, next)->idx);
-    dump_bufs(__func__, &v->w->iov);
-    sq_insert_head(&v->w->iov, v, next);
     ASAN_POISON_MEMORY_REGION(v->base, max_buf_len(v->w));
-    dump_bufs(__func__, &v->w->iov);
+    mag_put(v->w, v);
+}
+
+
+/// Append up to @p count w_iovs to @p vec, for eventual use with w_tx_vec().
+/// The w_iovs must be later returned to warpcore via w_free_vec(). Parameters
+/// @p len and @p off are as for w_alloc_cnt().
+///
+/// @param      w      Backend engine.
+/// @param[in]  af     Address family to allocate packet buffers.
+/// @param      vec    w_iov_vec to append to.
+/// @param[in]  count  Number of w_iovs to append.
+/// @param[in]  len    The length of each @p buf.
+/// @param[in]  off    Additional offset for @p buf.
+///
+/// @return     Number of w_iovs appended, which is less than @p count if @p vec
+///             filled up or there aren't enough buffers available.
+///
+uint32_t w_alloc_cnt_vec(struct w_engine * const w,
+                         const int af,
+                         struct w_iov_vec * const vec,
+                         const uint32_t count,
+                         const uint16_t len,
+                         const uint16_t off)
+{
+    const uint32_t want = MIN(count, W_IOV_VEC_MAX - vec->cnt);
+    uint32_t n;
+    for (n = 0; likely(n < want); n++) {
+        struct w_iov * const v = w_alloc_iov(w, af, len, off);
+        if (unlikely(v == 0))
+            break;
+        vec->v[vec->cnt++] = v;
+        vec->len += v->len;
+    }
+    return n;
+}
+
+
+#if defined(WITH_NETMAP) || defined(RIOT_VERSION)
+/// Send the w_iovs in @p vec over w_sock @p s, like w_tx() does for a w_iov_sq.
+/// Afterwards, @p vec holds what w_tx() would leave in its tail queue. This
+/// backend links the w_iovs into a w_iov_sq and passes that to w_tx().
+///
+/// @param      s     w_sock socket to transmit over.
+/// @param      vec   w_iov_vec to send.
+///
+/// @return     Number of w_iovs that were not handed off. They are the last
+///             ones in @p vec, and can be passed to w_tx_vec() again.
+///
+uint32_t w_tx_vec(struct w_sock * const s, struct w_iov_vec * const vec)
+{
+    if (unlikely(vec->cnt == 0))
+        return 0;
+
+    struct w_iov_sq o;
+    vec_to_sq(vec, &o);
+    const uint_t n = w_tx(s, &o);
+    vec->cnt = vec->len = 0;
+    sq_to_vec(&o, vec);
+    return (uint32_t)n;
+}
+#endif
+
+
+#if defined(WITH_NETMAP) || defined(RIOT_VERSION) || defined(WITH_URING)
+/// Append data that has been received on w_sock @p s to @p vec, as far as it
+/// fits. The w_iovs must eventually be returned to warpcore via w_free_vec().
+///
+/// Data that does not fit into @p vec stays queued on @p s, and is returned
+/// first by the next w_rx_vec() or w_rx() call. Callers should therefore call
+/// w_rx_vec() again for as long as it fills @p vec up. This backend receives
+/// into a w_iov_sq with w_rx() and moves what fits into @p vec.
+///
+/// @param      s     w_sock for which the application would like to receive new
+///                   data.
+/// @param      vec   w_iov_vec to append new data to.
+///
+/// @return     Number of w_iovs appended.
+///
+uint32_t w_rx_vec(struct w_sock * const s, struct w_iov_vec * const vec)
+{
+    const uint32_t cnt = vec->cnt;
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    sq_concat(&i, &s->iv);
+    w_rx(s, &i);
+    sq_to_vec(&i, vec);
+    sq_concat(&s->iv, &i);
+    return vec->cnt - cnt;
+}
+#endif
+
+
+/// Return the w_iovs in @p vec to warpcore, and empty @p vec. All of them must
+/// belong to the same engine.
+///
+/// @param      vec   w_iov_vec to return.
+///
+void w_free_vec(struct w_iov_vec * const vec)
+{
+    if (unlikely(vec->cnt == 0))
+        return;
+    struct w_iov_sq q;
+    vec_to_sq(vec, &q);
+    w_free(&q);
+    vec->cnt = vec->len = 0;
+}
+
+
+/// Verify the UDP checksum of the received w_iov @p v, if w_rx() has not
+/// already done so because its w_sock has w_sockopt::enable_lazy_udp_checksums
+/// set. Must be called before the application modifies the payload of @p v.
+///
+/// @param      v     A w_iov returned by w_rx() or w_rx_vec().
+///
+/// @return     False if @p v has an invalid UDP checksum, true otherwise.
+///
+bool w_iov_verify(struct w_iov * const v
+#ifndef WITH_NETMAP
+                  __attribute__((unused))
+#endif
+)
+{
+#ifdef WITH_NETMAP
+    if (unlikely(v->__unverified)) {
+        if (unlikely(udp_cksum_ok(v->base) == false))
+            return false;
+        v->__unverified = 0;
+    }
+#endif
+    return true;
 }
 
 
@@ -591,31 +1183,59 @@ uint32_t w_rand_uniform32(const uint32_t upper_bound)
 }
 
 
-static void __attribute__((no_instrument_function, nonnull))
-reinit_iov(struct w_iov * const v)
+void __attribute__((no_instrument_function))
+init_iov(struct w_engine * const w, struct w_iov * const v, const uint32_t idx)
 {
-    v->buf = v->base;
-    v->len = max_buf_len(v->w);
-    v->flags = v->ttl = 0;
-    sq_next(v, next) = 0;
+    *v = (struct w_iov){.w = w,
+                        .idx = idx,
+                        .base = idx_to_buf(w, idx),
+                        .saddr = &w->bufs_saddr[v - w->bufs]};
+    reinit_iov(v);
 }
 
 
-void __attribute__((no_instrument_function))
-init_iov(struct w_engine * const w, struct w_iov * const v, const uint32_t idx)
+/// Allocate the cache-line aligned w_engine::bufs array for @p n w_iovs, and
+/// the parallel w_engine::bufs_saddr array. The w_iovs must be initialized with
+/// init_iov() before use; memory for ones that never are is not touched.
+///
+/// @param      w     Backend engine.
+/// @param[in]  n     Number of w_iovs.
+///
+void alloc_bufs(struct w_engine * const w, const uint32_t n)
 {
-    v->w = w;
-    v->idx = idx;
-    v->base = idx_to_buf(w, v->idx);
-    reinit_iov(v);
+    void * bufs;
+    ensure(posix_memalign(&bufs, sizeof(*w->bufs), n * sizeof(*w->bufs)) == 0,
+           "cannot alloc %" PRIu32 " bufs", n);
+    w->bufs = bufs;
+    ensure((w->bufs_saddr = calloc(n, sizeof(*w->bufs_saddr))) != 0,
+           "cannot alloc %" PRIu32 " buf addrs", n);
+}
+
+
+/// Free the w_engine::bufs and w_engine::bufs_saddr arrays.
+///
+/// @param      w     Backend engine.
+///
+void free_bufs(struct w_engine * const w)
+{
+    free(w->bufs);
+    w->bufs = 0;
+    free(w->bufs_saddr);
+    w->bufs_saddr = 0;
 }
 
 
 struct w_iov * w_alloc_iov_base(struct w_engine * const w)
 {
-    struct w_iov * const v = sq_first(&w->iov);
+    struct w_iov * v;
+    struct w_mag * const m = mag_of(w);
+    if (likely(m) && likely(sq_empty(&m->cur) == false)) {
+        v = sq_first(&m->cur);
+        sq_remove_head(&m->cur, next);
+    } else
+        v = mag_get_slow(w, m);
+
     if (likely(v)) {
-        sq_remove_head(&w->iov, next);
         reinit_iov(v);
         ASAN_UNPOISON_MEMORY_REGION(v->base, v->len);
 #ifdef DEBUG_BUFFERS
@@ -636,7 +1256,7 @@ khint_t
            fnv1a_32(&tup->local.port, sizeof(tup->local.port)) +
            (tup->remote.addr.af
                 ? (w_addr_hash(&tup->remote.addr) +
-                   fnv1a_32(&tup->local.port, sizeof(tup->local.port)))
+                   fnv1a_32(&tup->remote.port, sizeof(tup->remote.port)))
                 : 0);
 }
 
@@ -26,11 +26,19 @@
 #include <cstdint>
 
 #include <benchmark/benchmark.h>
+#include <cstring>
 #include <warpcore/warpcore.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 extern "C" {
 #include "common.h"
-// #include "in_cksum.h"
+#include "in_cksum.h"
 }
 
 
@@ -47,16 +55,142 @@ static void BM_io(benchmark::State & state)
 }
 
 
-// static void BM_ip_cksum(benchmark::State & state)
-// {
-//     const auto len = uint16_t(state.range(0));
-//     auto * buf = new char[len];
-//     memset(buf, 'x', len);
-//     for (auto _ : state)
-//         benchmark::DoNotOptimize(ip_cksum(buf, len));
-//     state.SetBytesProcessed(int64_t(state.iterations()) * len);
-//     delete[] buf;
-// }
+static void BM_io_no_gso(benchmark::State & state)
+{
+    struct w_sockopt opt = s_clnt->opt;
+    opt.disable_udp_gso = true;
+    w_set_sockopt(s_clnt, &opt);
+    BM_io(state);
+    opt.disable_udp_gso = false;
+    w_set_sockopt(s_clnt, &opt);
+}
+
+
+static void BM_io_zerocopy(benchmark::State & state)
+{
+    struct w_sockopt opt = s_clnt->opt;
+    opt.enable_zerocopy = true;
+    w_set_sockopt(s_clnt, &opt);
+    BM_io(state);
+    opt.enable_zerocopy = false;
+    w_set_sockopt(s_clnt, &opt);
+}
+
+
+static void BM_io_gro(benchmark::State & state)
+{
+    struct w_sockopt opt = s_serv->opt;
+    opt.enable_udp_gro = true;
+    w_set_sockopt(s_serv, &opt);
+    BM_io(state);
+    opt.enable_udp_gro = false;
+    w_set_sockopt(s_serv, &opt);
+}
+
+
+// Open a counter for the cache misses of the calling thread, or return -1 if
+// the platform or kernel doesn't let us.
+static int cache_miss_counter()
+{
+#ifdef __linux__
+    struct perf_event_attr pe = {};
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = PERF_COUNT_HW_CACHE_MISSES;
+    pe.disabled = 1;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0));
+#else
+    return -1;
+#endif
+}
+
+
+static void BM_alloc_free(benchmark::State & state)
+{
+    const auto len = uint_t(state.range(0));
+    const int fd = cache_miss_counter();
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    struct w_iov_sq q = w_iov_sq_initializer(q);
+    for (auto _ : state) {
+        w_alloc_cnt(s_clnt->w, s_clnt->ws_af, &q, len, 0, 0);
+        if (w_iov_sq_cnt(&q) != len) {
+            state.SkipWithError("ran out of bufs");
+            break;
+        }
+        // touch the buffers, like an application would
+        struct w_iov * v;
+        sq_foreach (v, &q, next)
+            v->buf[0] = 0;
+        w_free(&q);
+    }
+    w_free(&q);
+    state.SetItemsProcessed(int64_t(state.iterations()) * len);
+    if (fd >= 0) {
+        uint64_t misses = 0;
+#ifdef __linux__
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+            misses = 0;
+        close(fd);
+#endif
+        state.counters["misses/buf"] =
+            double(misses) / (double(state.iterations()) * len);
+    }
+}
+
+
+static void BM_alloc_free_vec(benchmark::State & state)
+{
+    const auto len = uint32_t(state.range(0));
+    struct w_iov_vec vec = w_iov_vec_initializer(vec);
+    for (auto _ : state) {
+        if (w_alloc_cnt_vec(s_clnt->w, s_clnt->ws_af, &vec, len, 0, 0) !=
+            len) {
+            state.SkipWithError("ran out of bufs");
+            break;
+        }
+        // touch the buffers, like an application would
+        for (uint32_t j = 0; j < vec.cnt; j++)
+            vec.v[j]->buf[0] = 0;
+        w_free_vec(&vec);
+    }
+    w_free_vec(&vec);
+    state.SetItemsProcessed(int64_t(state.iterations()) * len);
+}
+
+
+static void BM_ip_cksum(benchmark::State & state)
+{
+    const auto len = uint16_t(state.range(0));
+    if (!cksum_use(uint8_t(state.range(1)))) {
+        state.SkipWithError("checksum kernel unsupported");
+        return;
+    }
+    auto * buf = new char[len];
+    memset(buf, 'x', len);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ip_cksum(buf, len));
+    state.SetBytesProcessed(int64_t(state.iterations()) * len);
+    delete[] buf;
+    cksum_use(CKSUM_AUTO);
+}
+
+
+static void cksum_args(benchmark::internal::Benchmark * b)
+{
+    b->ArgNames({"len", "kernel"});
+    for (const auto k : {CKSUM_SCALAR, CKSUM_AVX2, CKSUM_AVX512, CKSUM_NEON})
+        for (int64_t len = 64; len <= 2048; len *= 2)
+            b->Args({len, k});
+    b->Args({UINT16_MAX, CKSUM_AUTO});
+}
 
 
 // static void BM_arc4random(benchmark::State & state)
@@ -80,8 +214,13 @@ static void BM_io(benchmark::State & state)
 // }
 
 
+BENCHMARK(BM_alloc_free)->RangeMultiplier(4)->Range(1, 4096);
+BENCHMARK(BM_alloc_free_vec)->RangeMultiplier(4)->Range(1, W_IOV_VEC_MAX);
 BENCHMARK(BM_io)->RangeMultiplier(2)->Range(1, 512);
-// BENCHMARK(BM_ip_cksum)->RangeMultiplier(2)->Range(64, 2048);
+BENCHMARK(BM_io_no_gso)->RangeMultiplier(2)->Range(1, 512);
+BENCHMARK(BM_io_gro)->RangeMultiplier(2)->Range(1, 512);
+BENCHMARK(BM_io_zerocopy)->RangeMultiplier(2)->Range(1, 512);
+BENCHMARK(BM_ip_cksum)->Apply(cksum_args);
 // BENCHMARK(BM_arc4random);
 // BENCHMARK(BM_random);
 // BENCHMARK(BM_w_rand);
@@ -23,6 +23,7 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,7 +45,8 @@ extern int LLVMFuzzerInitialize(int * argc, char *** argv);
 
 
 static struct netmap_if *iface, i_init = {.ni_rx_rings = 1};
-static struct w_backend b;
+static struct nm_group g;
+static struct w_backend b = {.grp = &g, .nrxr = 1};
 __extension__ static struct w_engine w = {
     .b = &b,
     .ifaddr = {[0] = {.addr = {.af = AF_INET, .ip4 = 0x0100007f},
@@ -62,6 +64,7 @@ static int init(void)
     ensure(iface, "could not calloc");
     memcpy(iface, &i_init, sizeof(*iface));
     b.nif = iface;
+    ensure(pthread_mutex_init(&g.lock, 0) == 0, "pthread_mutex_init");
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wcast-qual"
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <warpcore/warpcore.h>
+
+#include "in_cksum.h"
+#include "ip4.h"
+#include "ip6.h"
+
+
+static uint8_t buf[UINT16_MAX + 1 + 64];
+
+
+static void
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+    __attribute__((no_sanitize("alignment")))
+#endif
+    check(const uint8_t impl, const uint16_t off, const uint16_t len)
+{
+    uint8_t * const b = &buf[off];
+
+    ensure(cksum_use(CKSUM_SCALAR), "scalar kernel unsupported");
+    const uint16_t ref = ip_cksum(b, len);
+    ensure(cksum_use(impl), "kernel %u unsupported", impl);
+    ensure(ip_cksum(b, len) == ref, "kernel %u: ip_cksum off %u len %u", impl,
+           off, len);
+
+    // partial sums over even-length pieces add up to the same checksum
+    const uint16_t half = (len / 2) & (uint16_t)~1;
+    ensure(ip_cksum_fold(ip_cksum_partial(b, half) +
+                         ip_cksum_partial(b + half, len - half)) == ref,
+           "kernel %u: ip_cksum_partial off %u len %u", impl, off, len);
+
+    if (len >= sizeof(struct ip4_hdr)) {
+        struct ip4_hdr * const ip = (void *)b;
+        ip->vhl = (4 << 4) | 5;
+        ip->p = 17;
+        ip->len = bswap16(len);
+        ensure(cksum_use(CKSUM_SCALAR), "scalar kernel unsupported");
+        const uint16_t ref4 = payload_cksum(b, len);
+        ensure(cksum_use(impl), "kernel %u unsupported", impl);
+        ensure(payload_cksum(b, len) == ref4,
+               "kernel %u: IPv4 payload_cksum off %u len %u", impl, off, len);
+    }
+
+    if (len >= sizeof(struct ip6_hdr)) {
+        struct ip6_hdr * const ip = (void *)b;
+        ip->vfc = 6 << 4;
+        ip->next_hdr = 17;
+        ip->len = bswap16(len - sizeof(*ip));
+        ensure(cksum_use(CKSUM_SCALAR), "scalar kernel unsupported");
+        const uint16_t ref6 = payload_cksum(b, len);
+        ensure(cksum_use(impl), "kernel %u unsupported", impl);
+        ensure(payload_cksum(b, len) == ref6,
+               "kernel %u: IPv6 payload_cksum off %u len %u", impl, off, len);
+    }
+}
+
+
+int main(void)
+{
+    w_init_rand();
+    for (size_t i = 0; i < sizeof(buf); i += sizeof(uint64_t)) {
+        const uint64_t r = w_rand64();
+        memcpy(&buf[i], &r, sizeof(r));
+    }
+
+    // a buffer of all ones sums to the largest possible value
+    memset(&buf[UINT16_MAX / 2], 0xff, UINT16_MAX / 2);
+
+    static const uint8_t impls[] = {CKSUM_AVX2, CKSUM_AVX512, CKSUM_NEON};
+    for (size_t k = 0; k < sizeof(impls); k++) {
+        if (cksum_use(impls[k]) == false) {
+            warn(NTE, "checksum kernel %u unsupported, skipping", impls[k]);
+            continue;
+        }
+        warn(NTE, "testing checksum kernel %u", impls[k]);
+        for (uint16_t off = 0; off < 8; off++)
+            for (uint16_t len = 0; len <= 2048 + 130; len++)
+                check(impls[k], off, len);
+        for (uint16_t len = UINT16_MAX - 130; len != 0; len++) {
+            check(impls[k], 1, len);
+            check(impls[k], UINT16_MAX / 2, UINT16_MAX / 2 + 1 - (len & 7));
+        }
+    }
+    ensure(cksum_use(CKSUM_AUTO), "no checksum kernel");
+}
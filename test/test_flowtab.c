@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <warpcore/warpcore.h>
+
+#include "flowtab.h"
+
+
+#define N 20000 ///< Number of connected w_socks.
+#define L 8     ///< Number of bound-only w_socks.
+
+
+static void init_addr(struct w_sockaddr * const sa,
+                      const bool v6,
+                      const uint32_t a,
+                      const uint16_t port)
+{
+    *sa = (struct w_sockaddr){.port = bswap16(port)};
+    sa->addr.af = v6 ? AF_INET6 : AF_INET;
+    if (v6) {
+        sa->addr.ip6[0] = 0xfd;
+        memcpy(&sa->addr.ip6[12], &a, sizeof(a));
+    } else
+        sa->addr.ip4 = a;
+}
+
+
+int main(void)
+{
+    struct flowtab ft = {0};
+    struct w_sock * const s = calloc(N + L, sizeof(*s));
+    ensure(s, "calloc");
+
+    // listeners on ports 1-L, and N connections to port 1 from many peers
+    for (uint32_t i = 0; i < L; i++) {
+        init_addr(&s[N + i].ws_loc, i & 1, 1, (uint16_t)(i + 1));
+        flowtab_ins(&ft, &s[N + i]);
+    }
+    for (uint32_t i = 0; i < N; i++) {
+        init_addr(&s[i].ws_loc, i & 1, 1, 1);
+        init_addr(&s[i].ws_rem, i & 1, i / 100, (uint16_t)(1 + i % 100));
+        flowtab_ins(&ft, &s[i]);
+    }
+    ensure(ft.cnt == N + L, "cnt %u", ft.cnt);
+
+    for (uint32_t i = 0; i < N; i++) {
+        ensure(flowtab_demux(&ft, &s[i].ws_loc, &s[i].ws_rem) == &s[i],
+               "connected %u", i);
+        ensure(flowtab_get(&ft, &s[i].ws_loc, &s[i].ws_rem) == &s[i],
+               "get %u", i);
+    }
+
+    // unknown peers go to the listener, unknown ports nowhere
+    struct w_sockaddr loc;
+    struct w_sockaddr rem;
+    for (uint32_t i = 0; i < 2 * L; i++) {
+        init_addr(&loc, i & 1, 1, (uint16_t)(i + 1));
+        init_addr(&rem, i & 1, UINT32_MAX, 4242);
+        ensure(flowtab_demux(&ft, &loc, &rem) == (i < L ? &s[N + i] : 0),
+               "listener %u", i);
+        ensure(flowtab_get(&ft, &loc, &rem) == 0, "get listener %u", i);
+    }
+
+    // remove every other connection; those now go to the listener
+    for (uint32_t i = 0; i < N; i += 2)
+        flowtab_del(&ft, &s[i]);
+    ensure(ft.cnt == N / 2 + L, "cnt %u after del", ft.cnt);
+    for (uint32_t i = 0; i < N; i++)
+        ensure(flowtab_demux(&ft, &s[i].ws_loc, &s[i].ws_rem) ==
+                   (i & 1 ? &s[i] : &s[N]),
+               "after del %u", i);
+
+    // re-insert them, which reuses deleted slots
+    for (uint32_t i = 0; i < N; i += 2)
+        flowtab_ins(&ft, &s[i]);
+
+    uint32_t n = 0;
+    struct w_sock * x;
+    flowtab_foreach(&ft, x, {
+        ensure(flowtab_demux(&ft, &x->ws_loc,
+                             w_connected(x) ? &x->ws_rem : &rem) == x,
+               "foreach");
+        n++;
+    });
+    ensure(n == N + L, "foreach saw %u", n);
+
+    // removal during iteration
+    flowtab_foreach(&ft, x, { flowtab_del(&ft, x); });
+    ensure(ft.cnt == 0, "cnt %u after removing all", ft.cnt);
+
+    flowtab_free(&ft);
+    free(s);
+}
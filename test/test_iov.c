@@ -26,7 +26,9 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <string.h>
 
 #ifdef __FreeBSD__
 #include <netinet/in.h>
@@ -41,6 +43,21 @@
 #define beg(v) idx_to_buf(w, w_iov_idx(v))
 
 
+/// Allocate and free a w_iov of engine @p arg, so that the calling thread
+/// caches some, and exit without returning them.
+///
+/// @param      arg   Backend engine.
+///
+/// @return     Zero.
+///
+static void * cache_and_exit(void * const arg)
+{
+    struct w_engine * const w = arg;
+    w_free_iov(w_alloc_iov(w, AF_INET6, 0, 0));
+    return 0;
+}
+
+
 int main(void)
 {
     init(8192);
@@ -130,5 +147,47 @@ int main(void)
         w_free(&q);
     }
 
+    // an engine whose pool grows on demand (and shrinks again)
+    const uint32_t nbufs = 16;
+    struct w_engine * const g =
+        w_init(w->ifname, 0, nbufs,
+               &(struct w_engopt){.max_bufs = nbufs + 3 * (2 * 1024 * 1024) /
+                                                          max_buf_len(w)});
+    const uint32_t chunk = g->b->chunk_bufs;
+    sq_init(&q);
+    w_alloc_cnt(g, AF_INET6, &q, nbufs + 2 * chunk + 1, 0, 0);
+    ensure(w_iov_sq_cnt(&q) == nbufs + 2 * chunk + 1, "pool did not grow");
+    ensure(g->b->nchunks == 3, "%u chunks != 3", g->b->nchunks);
+    sq_foreach (v, &q, next) {
+        ensure(w_iov(g, w_iov_idx(v)) == v, "idx mismatch");
+        ensure(v->base == idx_to_buf(g, w_iov_idx(v)), "base incorrect");
+        memset(v->base, 0xff, max_buf_len(g));
+    }
+    w_free(&q);
+
+    // idle chunks are released, keeping one chunk's worth of spare bufs
+    for (int n = 0; g->b->nchunks > 1 && n < 50; n++)
+        w_nic_rx(g, 20 * NS_PER_MS);
+    ensure(g->b->nchunks == 1, "%u chunks != 1", g->b->nchunks);
+    ensure(w_iov_sq_cnt(&g->iov) == nbufs + chunk, "pool size %" PRIu,
+           w_iov_sq_cnt(&g->iov));
+    ensure(g->b->chunk_free[0] == chunk, "%u of %u chunk bufs free",
+           g->b->chunk_free[0], chunk);
+
+    // but can grow again
+    w_alloc_cnt(g, AF_INET6, &q, nbufs + 2 * chunk, 0, 0);
+    ensure(w_iov_sq_cnt(&q) == nbufs + 2 * chunk, "pool did not regrow");
+    w_free(&q);
+
+    // threads that exit return the w_iovs they cache
+    w_release_bufs(g);
+    const uint_t free_bufs = w_iov_sq_cnt(&g->iov);
+    pthread_t t;
+    ensure(pthread_create(&t, 0, cache_and_exit, g) == 0, "pthread_create");
+    ensure(pthread_join(t, 0) == 0, "pthread_join");
+    ensure(w_iov_sq_cnt(&g->iov) == free_bufs, "%" PRIu " of %" PRIu " free",
+           w_iov_sq_cnt(&g->iov), free_bufs);
+    w_cleanup(g);
+
     cleanup();
 }
@@ -25,38 +25,91 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <inttypes.h>
 #include <netinet/in.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/socket.h>
+#include <time.h>
 
 #include <warpcore/warpcore.h>
 
 #include "common.h"
 
 
+#define LOOPS 1000 ///< Event loop iterations to average over.
+
+
+/// Measure the average cost of one event loop iteration on w_serv, in which
+/// s_serv receives one packet from s_clnt, while the other w_socks on w_serv
+/// stay idle.
+///
+/// @return     Average time per iteration in nanoseconds.
+///
+static uint64_t loop_cost(void)
+{
+    const uint64_t start = w_now(CLOCK_MONOTONIC);
+    for (uint32_t l = 0; l < LOOPS; l++) {
+        struct w_iov_sq o = w_iov_sq_initializer(o);
+        w_alloc_cnt(w_clnt, s_clnt->ws_af, &o, 1, 64, 0);
+        ensure(w_tx(s_clnt, &o) == 0, "w_tx");
+        w_nic_tx(w_clnt);
+
+        struct w_sock_slist sl = w_sock_slist_initializer(sl);
+        for (int n = 0; n < 10 && w_rx_ready(w_serv, &sl) == 0; n++)
+            w_nic_rx(w_serv, 100 * NS_PER_MS);
+        ensure(sl_first(&sl) == s_serv && sl_next(s_serv, next) == 0,
+               "only s_serv ready");
+
+        struct w_iov_sq i = w_iov_sq_initializer(i);
+        w_rx(s_serv, &i);
+        ensure(w_iov_sq_cnt(&i) == 1, "rx");
+        w_free(&i);
+        w_free(&o);
+    }
+    return (w_now(CLOCK_MONOTONIC) - start) / LOOPS;
+}
+
+
 int main(void)
 {
     init(64 * 1024);
 
     // util_dlevel = WRN;
 
+    // open as many connections on w_serv as possible, and measure the event
+    // loop cost at each power of ten
+    struct w_sock ** const s = calloc(UINT16_MAX, sizeof(*s));
+    ensure(s, "calloc");
     int n = 0;
-    while (1) {
-        struct w_sock * const s = w_bind(w_clnt, 0, 0, 0);
-        if (s == 0)
+    for (int next = 1; n < UINT16_MAX; n++) {
+        if (n == next) {
+            warn(WRN, "%d idle connections: %" PRIu64 " ns per event loop", n,
+                 loop_cost());
+            next *= 10;
+        }
+        s[n] = w_bind(w_serv, 0, 0, 0);
+        if (s[n] == 0)
             break;
-        w_connect(s, (struct sockaddr *)&(struct sockaddr_in6){
-                         .sin6_family = AF_INET6,
-                         .sin6_addr = IN6ADDR_LOOPBACK_INIT,
-                         .sin6_port = bswap16(55555)});
-        if (w_connected(s) == false)
+        w_connect(s[n], (struct sockaddr *)&(struct sockaddr_in6){
+                            .sin6_family = AF_INET6,
+                            .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+                            .sin6_port = bswap16(55555)});
+        if (w_connected(s[n]) == false) {
+            w_close(s[n]);
             break;
-        n++;
+        }
     }
 
     // util_dlevel = DBG;
 
     warn(WRN, "Was able to open %d connections", n);
+    warn(WRN, "%d idle connections: %" PRIu64 " ns per event loop", n,
+         loop_cost());
 
+    while (n)
+        w_close(s[--n]);
+    free(s);
     cleanup();
 }
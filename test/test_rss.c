@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <warpcore/warpcore.h>
+
+#include "rss.h"
+
+
+/// A verification vector from the Microsoft RSS specification.
+struct vec {
+    const char * src;
+    uint16_t sport;
+    const char * dst;
+    uint16_t dport;
+    uint32_t ip;      ///< Hash over the addresses.
+    uint32_t ip_port; ///< Hash over the addresses and ports.
+};
+
+
+static const struct vec vecs[] = {
+    {"66.9.149.187", 2794, "161.142.100.80", 1766, 0x323e8fc2, 0x51ccc178},
+    {"199.92.111.2", 14230, "65.69.140.83", 4739, 0xd718262a, 0xc626b0ea},
+    {"24.19.198.95", 12898, "12.22.207.184", 38024, 0xd2d0a5de, 0x5c2b394a},
+    {"38.27.205.30", 48228, "209.142.163.6", 2217, 0x82989176, 0xafc7327f},
+    {"153.39.163.191", 44251, "202.188.127.2", 1303, 0x5d1809c5, 0x10e828a2},
+    {"3ffe:2501:200:1fff::7", 2794, "3ffe:2501:200:3::1", 1766, 0x2cc18cd5,
+     0x40207d3d},
+    {"3ffe:501:8::260:97ff:fe40:efab", 14230, "ff02::1", 4739, 0x0f0c461c,
+     0xdde51bbf},
+    {"3ffe:1900:4545:3:200:f8ff:fe21:67cf", 44251, "fe80::200:f8ff:fe21:67cf",
+     38024, 0x4b61e985, 0x02d1feef},
+};
+
+
+static void init_addr(struct w_sockaddr * const sa,
+                      const char * const addr,
+                      const uint16_t port)
+{
+    *sa = (struct w_sockaddr){.port = bswap16(port)};
+    sa->addr.af = strchr(addr, ':') ? AF_INET6 : AF_INET;
+    ensure(inet_pton(sa->addr.af, addr,
+                     sa->addr.af == AF_INET ? (void *)&sa->addr.ip4
+                                            : (void *)sa->addr.ip6) == 1,
+           "inet_pton %s", addr);
+}
+
+
+int main(void)
+{
+    // lo has no RSS, so this yields the defaults
+    struct rss rss = {0};
+    rss_init(&rss, "lo", 4);
+    ensure(rss.key_len == sizeof(rss_default_key) &&
+               memcmp(rss.key, rss_default_key, rss.key_len) == 0,
+           "default key");
+    ensure(rss.indir_len == RSS_INDIR_LEN, "default indir_len");
+    for (uint32_t i = 0; i < rss.indir_len; i++)
+        ensure(rss.indir[i] == i % 4, "default indir %u", i);
+
+    for (uint32_t i = 0; i < sizeof(vecs) / sizeof(vecs[0]); i++) {
+        struct w_sockaddr src;
+        struct w_sockaddr dst;
+        init_addr(&src, vecs[i].src, vecs[i].sport);
+        init_addr(&dst, vecs[i].dst, vecs[i].dport);
+
+        rss.ports4 = rss.ports6 = false;
+        const uint32_t ip = rss_hash(&rss, &src, &dst);
+        ensure(ip == vecs[i].ip, "vec %u: ip hash 0x%08x != 0x%08x", i, ip,
+               vecs[i].ip);
+
+        rss.ports4 = rss.ports6 = true;
+        const uint32_t ip_port = rss_hash(&rss, &src, &dst);
+        ensure(ip_port == vecs[i].ip_port,
+               "vec %u: ip+port hash 0x%08x != 0x%08x", i, ip_port,
+               vecs[i].ip_port);
+        ensure(rss_ring(&rss, &src, &dst) == (ip_port % RSS_INDIR_LEN) % 4,
+               "vec %u: ring", i);
+    }
+
+    // every ring is reachable by varying the destination port of a flow,
+    // which is what RSS-aware port selection relies on
+    struct w_sockaddr src;
+    struct w_sockaddr dst;
+    init_addr(&src, vecs[0].src, vecs[0].sport);
+    uint32_t seen = 0;
+    for (uint16_t p = 1024; p < 1024 + 64; p++) {
+        init_addr(&dst, vecs[0].dst, p);
+        seen |= 1U << rss_ring(&rss, &src, &dst);
+    }
+    ensure(seen == 0xf, "rings reached 0x%x", seen);
+
+    return 0;
+}
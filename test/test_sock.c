@@ -25,14 +25,194 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <warpcore/warpcore.h>
 
 #include "common.h"
 
 
+static void io_vec(void)
+{
+    struct w_iov_vec o = w_iov_vec_initializer(o);
+    ensure(w_alloc_cnt_vec(w_clnt, s_clnt->ws_af, &o, 2 * W_IOV_VEC_MAX, 512,
+                           0) == W_IOV_VEC_MAX,
+           "vec not filled");
+    ensure(o.len == W_IOV_VEC_MAX * 512, "vec len %" PRIu32, o.len);
+    for (uint32_t j = 0; j < o.cnt; j++)
+        memset(o.v[j]->buf, (int)j, o.v[j]->len);
+
+    // tx (sends over loopback never block)
+    ensure(w_tx_vec(s_clnt, &o) == 0, "vec tx incomplete");
+    ensure(o.cnt == W_IOV_VEC_MAX, "vec changed");
+    w_nic_tx(w_clnt);
+    w_free_vec(&o);
+    ensure(o.cnt == 0 && o.len == 0, "vec not emptied");
+
+    // receive into a half-full vector, so half the data is left over
+    const uint32_t half = W_IOV_VEC_MAX / 2;
+    struct w_iov_vec a = w_iov_vec_initializer(a);
+    w_alloc_cnt_vec(w_serv, s_serv->ws_af, &a, half, 0, 0);
+    const uint32_t alen = a.len;
+    for (int n = 0; a.cnt < W_IOV_VEC_MAX && n < 10; n++)
+        if (w_rx_vec(s_serv, &a) == 0)
+            w_nic_rx(w_serv, 100 * NS_PER_MS);
+    ensure(a.cnt == W_IOV_VEC_MAX, "vec rx %" PRIu32, a.cnt);
+    ensure(a.len == alen + half * 512, "vec rx len %" PRIu32, a.len);
+
+    struct w_iov_vec b = w_iov_vec_initializer(b);
+    ensure(w_rx_vec(s_serv, &b) == half, "leftover rx %" PRIu32, b.cnt);
+
+    for (uint32_t j = 0; j < W_IOV_VEC_MAX; j++) {
+        const struct w_iov * const v = j < half ? a.v[half + j] : b.v[j - half];
+        ensure(v->len == 512 && v->buf[0] == (uint8_t)j &&
+                   v->buf[511] == (uint8_t)j,
+               "vec rx data mismatch at %" PRIu32, j);
+        ensure(v->wv_port == s_clnt->ws_lport, "port mismatch");
+    }
+    w_free_vec(&a);
+    w_free_vec(&b);
+    ensure(w_rx_vec(s_serv, &b) == 0, "extra data");
+}
+
+
+static void gro(void)
+{
+    // the kernel coalesces what arrives back-to-back, and w_rx() splits it up
+    struct w_sockopt opt = s_serv->opt;
+    opt.enable_udp_gro = true;
+    w_set_sockopt(s_serv, &opt);
+#if defined(HAVE_UDP_GRO) && !defined(WITH_URING) && !defined(WITH_NETMAP)
+    ensure(s_serv->opt.enable_udp_gro, "cannot enable GRO");
+#endif
+    for (uint32_t i = 1; i <= 128; i <<= 1)
+        ensure(io(i), "GRO io %" PRIu32, i);
+    opt.enable_udp_gro = false;
+    w_set_sockopt(s_serv, &opt);
+}
+
+
+static void lazy_cksum(void)
+{
+    // w_rx() leaves checksum verification to w_iov_verify(), which io() calls
+    struct w_sockopt opt = s_serv->opt;
+    opt.enable_lazy_udp_checksums = true;
+    w_set_sockopt(s_serv, &opt);
+    for (uint32_t i = 1; i <= 128; i <<= 1)
+        ensure(io(i), "lazy checksum io %" PRIu32, i);
+    opt.enable_lazy_udp_checksums = false;
+    w_set_sockopt(s_serv, &opt);
+}
+
+
+#ifndef WITH_NETMAP
+/// Serve from a new engine with options @p eopt for a while.
+///
+/// @param[in]  eopt  Engine options.
+///
+/// @return     The original server engine, to pass to restore_serv().
+///
+static struct w_engine * __attribute__((nonnull))
+swap_serv(const struct w_engopt * const eopt)
+{
+    struct w_engine * const w = w_serv;
+    const struct w_sockopt opt = s_serv->opt;
+    w_close(s_serv);
+    w_serv = w_init(w->ifname, 0, 8 * 1024, eopt);
+    s_serv = w_bind(w_serv, 0, bswap16(55555), &opt);
+    return w;
+}
+
+
+/// Go back to serving from engine @p w after swap_serv().
+///
+/// @param      w     The original server engine.
+///
+static void __attribute__((nonnull)) restore_serv(struct w_engine * const w)
+{
+    const struct w_sockopt opt = s_serv->opt;
+    w_close(s_serv);
+    w_cleanup(w_serv);
+    w_serv = w;
+    s_serv = w_bind(w_serv, 0, bswap16(55555), &opt);
+}
+
+
+static void busy_poll(void)
+{
+    // kernel busy-polling (if permitted) must not get in the way of I/O
+    struct w_engine * const w = swap_serv(&(struct w_engopt){
+        .busy_poll_us = 50,
+        .enable_prefer_busy_poll = true,
+#ifdef __linux__
+        // with a single engine, every queue steers to the one w_sock
+        .enable_reuseport = true,
+        .reuseport_by_queue = true,
+        .reuseport_engines = 1,
+#endif
+    });
+    for (uint32_t i = 1; i <= 128; i <<= 1)
+        ensure(io(i), "busy-poll io %" PRIu32, i);
+    restore_serv(w);
+}
+#endif
+
+
+#if (defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)) && !defined(WITH_URING) && \
+    !defined(WITH_NETMAP)
+static void edge_triggered(void)
+{
+    struct w_engine * const w =
+        swap_serv(&(struct w_engopt){.enable_edge_triggered = true});
+    for (uint32_t i = 1; i <= 128; i <<= 1)
+        ensure(io(i), "edge-triggered io %" PRIu32, i);
+
+    // a burst is reported once, even if it is not read right away
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(w_clnt, s_clnt->ws_af, &o, 8, 0, 0);
+    ensure(w_tx(s_clnt, &o) == 0, "w_tx");
+    w_nic_tx(w_clnt);
+    w_free(&o);
+    ensure(w_nic_rx(w_serv, 100 * NS_PER_MS), "burst not reported");
+    struct w_sock_slist sl = w_sock_slist_initializer(sl);
+    ensure(w_rx_ready(w_serv, &sl) == 1 && sl_first(&sl) == s_serv,
+           "w_sock not ready");
+    ensure(w_nic_rx(w_serv, 0) == false, "burst reported twice");
+
+    // and w_rx() then reads all of it
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    w_rx(s_serv, &i);
+    ensure(w_iov_sq_cnt(&i) == 8, "rx %" PRIu, w_iov_sq_cnt(&i));
+    w_free(&i);
+    restore_serv(w);
+}
+#endif
+
+
+static void nic_rx(void)
+{
+    // sub-millisecond timeouts must be honored, not rounded down to zero
+    for (int n = 0; n < 2; n++) {
+        w_serv->opt.enable_adaptive_poll = n;
+        const uint64_t t = w_now(CLOCK_MONOTONIC);
+        ensure(w_nic_rx(w_serv, 200 * NS_PER_US) == false, "spurious rx");
+        const uint64_t dur = w_now(CLOCK_MONOTONIC) - t;
+        ensure(dur >= 200 * NS_PER_US, "timeout too short: %" PRIu64, dur);
+    }
+
+    // adaptive polling still sees data arrive
+    for (uint32_t i = 0; i < 16; i++)
+        ensure(io(64), "adaptive io %" PRIu32, i);
+    w_serv->opt.enable_adaptive_poll = false;
+
+    // loopback has no NAPI instances
+    ensure(w_napi_id(s_serv) == 0, "NAPI ID %" PRIu32, w_napi_id(s_serv));
+}
+
+
 int main(void)
 {
     init(64 * 1024);
@@ -43,5 +223,16 @@ int main(void)
         }
         warn(INF, "test len %u ok", i);
     }
+    io_vec();
+    gro();
+    lazy_cksum();
+#ifndef WITH_NETMAP
+    busy_poll();
+#endif
+#if (defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)) && !defined(WITH_URING) && \
+    !defined(WITH_NETMAP)
+    edge_triggered();
+#endif
+    nic_rx();
     cleanup();
 }
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: BSD-2-Clause
+//
+// Copyright (c) 2014-2020, NetApp, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <warpcore/warpcore.h>
+
+
+#define NCLNT 100 ///< Number of client w_socks.
+
+
+/// Send one packet carrying @p tag over w_sock @p s.
+///
+/// @param      s     The w_sock to send over.
+/// @param[in]  tag   Value of the first payload byte.
+///
+static void send_tag(struct w_sock * const s, const uint8_t tag)
+{
+    struct w_iov_sq o = w_iov_sq_initializer(o);
+    w_alloc_cnt(s->w, s->ws_af, &o, 1, 64, 0);
+    sq_first(&o)->buf[0] = tag;
+    ensure(w_tx(s, &o) == 0, "w_tx");
+    w_nic_tx(s->w);
+    w_free(&o);
+}
+
+
+/// Wait until w_rx_ready() on engine @p w reports some w_socks.
+///
+/// @param      w     Backend engine.
+/// @param      sl    Empty and initialized w_sock_slist.
+///
+/// @return     Number of ready w_socks.
+///
+static uint32_t wait_ready(struct w_engine * const w,
+                           struct w_sock_slist * const sl)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < 10 && (n = w_rx_ready(w, sl)) == 0; i++)
+        w_nic_rx(w, 100 * NS_PER_MS);
+    return n;
+}
+
+
+/// Wait for a packet on w_sock @p s, and return the tag it carries.
+///
+/// @param      s     The w_sock to receive on.
+///
+/// @return     Value of the first payload byte, or -1 if nothing arrived.
+///
+static int rx_tag(struct w_sock * const s)
+{
+    struct w_iov_sq i = w_iov_sq_initializer(i);
+    for (int n = 0; n < 10 && sq_empty(&i); n++) {
+        w_nic_rx(s->w, 100 * NS_PER_MS);
+        w_rx(s, &i);
+    }
+    const int tag = sq_empty(&i) ? -1 : sq_first(&i)->buf[0];
+    w_free(&i);
+    return tag;
+}
+
+
+int main(void)
+{
+    char i[IFNAMSIZ] = "lo"
+#ifndef __linux__
+                       "0"
+#endif
+        ;
+
+    struct w_engine * const ws =
+        w_init(i, 0, 8192, &(struct w_engopt){.enable_virtual_socks = true});
+    struct w_engine * const wc = w_init(i, 0, 8192, 0);
+
+    struct w_sock * const lsn = w_bind(ws, 0, bswap16(55557), 0);
+    ensure(lsn, "w_bind");
+
+    // every client sends one packet, which arrives at the unconnected w_sock
+    struct w_sock * clnt[NCLNT];
+    for (uint8_t c = 0; c < NCLNT; c++) {
+        clnt[c] = w_bind(wc, 0, 0, 0);
+        w_connect(clnt[c], (struct sockaddr *)&(struct sockaddr_in6){
+                               .sin6_family = AF_INET6,
+                               .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+                               .sin6_port = lsn->ws_lport});
+        ensure(w_connected(clnt[c]), "client connected");
+        send_tag(clnt[c], c);
+    }
+
+    struct w_iov_sq q = w_iov_sq_initializer(q);
+    for (int n = 0; n < 10 && w_iov_sq_cnt(&q) < NCLNT; n++) {
+        struct w_sock_slist sl = w_sock_slist_initializer(sl);
+        if (wait_ready(ws, &sl)) {
+            ensure(sl_first(&sl) == lsn && sl_next(lsn, next) == 0,
+                   "only listener ready");
+            w_rx(lsn, &q);
+        }
+    }
+    ensure(w_iov_sq_cnt(&q) == NCLNT, "listener rx %" PRIu,
+           w_iov_sq_cnt(&q));
+
+    // accept a virtual connection for each, sharing the kernel socket
+    struct w_sock * srv[NCLNT];
+    struct w_iov * v;
+    sq_foreach (v, &q, next) {
+        const uint8_t c = v->buf[0];
+        srv[c] = w_bind(ws, 0, lsn->ws_lport, 0);
+        ensure(srv[c] && srv[c]->fd == lsn->fd, "shared fd");
+        struct sockaddr_in6 sa = {.sin6_family = AF_INET6,
+                                  .sin6_port = v->wv_port};
+        memcpy(&sa.sin6_addr, v->wv_ip6, sizeof(sa.sin6_addr));
+        ensure(w_connect(srv[c], (struct sockaddr *)&sa) == 0, "w_connect");
+    }
+    w_free(&q);
+
+    // now packets from the clients go to their own w_socks
+    for (uint8_t c = 0; c < NCLNT; c++)
+        send_tag(clnt[c], c);
+    uint32_t got = 0;
+    for (int n = 0; n < 10 && got < NCLNT; n++) {
+        struct w_sock_slist sl = w_sock_slist_initializer(sl);
+        wait_ready(ws, &sl);
+        struct w_sock * s;
+        sl_foreach (s, &sl, next) {
+            ensure(s != lsn, "listener not ready");
+            struct w_iov_sq i = w_iov_sq_initializer(i);
+            w_rx(s, &i);
+            sq_foreach (v, &i, next) {
+                ensure(s == srv[v->buf[0]], "demultiplexed to right w_sock");
+                got++;
+            }
+            w_free(&i);
+        }
+    }
+    ensure(got == NCLNT, "virtual rx %u", got);
+
+    // and replies go out to the right clients
+    for (uint8_t c = 0; c < NCLNT; c++) {
+        send_tag(srv[c], c);
+        struct w_iov_sq i = w_iov_sq_initializer(i);
+        for (int n = 0; n < 10 && sq_empty(&i); n++) {
+            w_nic_rx(wc, 100 * NS_PER_MS);
+            w_rx(clnt[c], &i);
+        }
+        ensure(w_iov_sq_cnt(&i) == 1 && sq_first(&i)->buf[0] == c, "reply");
+        w_free(&i);
+    }
+
+    // once a virtual w_sock is closed, its client reaches the listener again
+    w_close(srv[0]);
+    send_tag(clnt[0], 0);
+    for (int n = 0; n < 10 && sq_empty(&q); n++) {
+        w_nic_rx(ws, 100 * NS_PER_MS);
+        w_rx(lsn, &q);
+    }
+    ensure(w_iov_sq_cnt(&q) == 1, "listener rx after close");
+    struct sockaddr_in6 sa0 = {.sin6_family = AF_INET6,
+                               .sin6_port = sq_first(&q)->wv_port};
+    memcpy(&sa0.sin6_addr, sq_first(&q)->wv_ip6, sizeof(sa0.sin6_addr));
+    w_free(&q);
+
+    // when the listener connects, the next unconnected w_sock takes over
+    struct w_sock * const nxt = w_bind(ws, 0, lsn->ws_lport, 0);
+    ensure(w_connect(lsn, (struct sockaddr *)&sa0) == 0, "w_connect");
+    struct w_sock * const extra = w_bind(wc, 0, 0, 0);
+    w_connect(extra, (struct sockaddr *)&(struct sockaddr_in6){
+                         .sin6_family = AF_INET6,
+                         .sin6_addr = IN6ADDR_LOOPBACK_INIT,
+                         .sin6_port = lsn->ws_lport});
+    send_tag(clnt[0], 0);
+    ensure(rx_tag(lsn) == 0, "connected listener rx");
+    send_tag(extra, NCLNT);
+    ensure(rx_tag(nxt) == NCLNT, "promoted rx after connect");
+
+    // and when that one closes, the next one after it
+    struct w_sock * const nxt2 = w_bind(ws, 0, lsn->ws_lport, 0);
+    w_close(nxt);
+    send_tag(extra, NCLNT + 1);
+    ensure(rx_tag(nxt2) == NCLNT + 1, "promoted rx after close");
+    w_close(nxt2);
+    w_close(extra);
+
+    for (uint8_t c = 0; c < NCLNT; c++) {
+        if (c)
+            w_close(srv[c]);
+        w_close(clnt[c]);
+    }
+    w_close(lsn);
+    w_cleanup(ws);
+    w_cleanup(wc);
+}